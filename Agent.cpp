@@ -111,4 +111,58 @@ float Agent::GetRot() const
     if (m_ptr)
         return m_ptr->rot;
     return 0;
+}
+
+
+int Agent::GetStaleTicks() const
+{
+    if (m_ptr)
+        return m_ptr->staleTicks;
+    return 0;
+}
+
+
+bool Agent::IsStatic() const
+{
+    if (m_ptr)
+        return m_ptr->isStatic;
+    return false;
+}
+
+
+float Agent::GetDistanceToSelf() const
+{
+    if (m_ptr)
+        return m_ptr->distToSelf;
+    return 0;
+}
+
+float Agent::GetThreat() const
+{
+    if (m_ptr)
+        return m_ptr->threat;
+    return 0;
+}
+
+bool Agent::GetScreenPos(float *outX, float *outY) const
+{
+    if (!m_ptr || !m_ptr->onScreen)
+        return false;
+    *outX = m_ptr->screenPos.x;
+    *outY = m_ptr->screenPos.y;
+    return true;
+}
+
+int Agent::GetClusterId() const
+{
+    if (m_ptr)
+        return m_ptr->clusterId;
+    return -1;
+}
+
+EspLod Agent::GetEspLod() const
+{
+    if (m_ptr)
+        return m_ptr->espLod;
+    return ESP_LOD_HIDDEN;
 }
\ No newline at end of file
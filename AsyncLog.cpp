@@ -0,0 +1,252 @@
+#include "AsyncLog.h"
+
+#include "hacklib/Logging.h"
+
+#include <Windows.h>
+#include <thread>
+#include <string>
+#include <cstdio>
+#include <cstring>
+
+
+namespace
+{
+    // bounded multi producer queue, every cell carries a sequence number that tells producers
+    // and the consumer whose turn it is
+    const size_t QUEUE_SIZE = 1024;
+
+    struct Record
+    {
+        const char *format;
+        uint32_t suppressed;
+        int nArgs;
+        AsyncLog::Arg args[AsyncLog::MAX_ARGS];
+    };
+
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        Record record;
+    };
+
+    Cell g_cells[QUEUE_SIZE];
+    std::atomic<size_t> g_enqueuePos{0};
+    size_t g_dequeuePos = 0;
+    std::atomic<uint32_t> g_dropped{0};
+    // every site that logged at least once, pushed at the front
+    std::atomic<AsyncLog::Site*> g_sites{nullptr};
+
+    std::thread g_thread;
+    std::atomic<bool> g_bStop{false};
+
+    struct InitCells
+    {
+        InitCells() {
+            for (size_t i = 0; i < QUEUE_SIZE; i++)
+                g_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    } g_initCells;
+
+    bool Pop(Record &record)
+    {
+        Cell &cell = g_cells[g_dequeuePos % QUEUE_SIZE];
+        if (cell.sequence.load(std::memory_order_acquire) != g_dequeuePos + 1)
+            return false;
+        record = cell.record;
+        cell.sequence.store(g_dequeuePos + QUEUE_SIZE, std::memory_order_release);
+        g_dequeuePos++;
+        return true;
+    }
+
+    // printf with the captured arguments. the length modifiers of the format are replaced
+    // because every integer was widened to 64 bit
+    std::string Format(const Record &record)
+    {
+        std::string out;
+        const char *f = record.format;
+        int argIndex = 0;
+        char buf[128];
+
+        while (*f)
+        {
+            if (*f != '%') {
+                out += *f++;
+                continue;
+            }
+            if (f[1] == '%') {
+                out += '%';
+                f += 2;
+                continue;
+            }
+
+            std::string spec = "%";
+            f++;
+            while (*f && strchr("-+ #0123456789.", *f))
+                spec += *f++;
+            while (*f && strchr("hljztLI", *f))
+                f++;
+            while (*f >= '0' && *f <= '9')
+                f++;
+            char conv = *f;
+            if (!conv)
+                break;
+            f++;
+
+            if (argIndex >= record.nArgs) {
+                out += "<?>";
+                continue;
+            }
+            const AsyncLog::Arg &arg = record.args[argIndex++];
+
+            switch (conv)
+            {
+            case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+                spec += (conv == 'c') ? "c" : std::string("ll") + conv;
+                if (conv == 'c')
+                    snprintf(buf, sizeof(buf), spec.c_str(), static_cast<int>(arg.i));
+                else
+                    snprintf(buf, sizeof(buf), spec.c_str(), arg.i);
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                spec += conv;
+                snprintf(buf, sizeof(buf), spec.c_str(), arg.type == AsyncLog::Arg::ARG_DOUBLE ? arg.d : static_cast<double>(arg.i));
+                break;
+            case 's':
+                spec += 's';
+                snprintf(buf, sizeof(buf), spec.c_str(), arg.type == AsyncLog::Arg::ARG_STR && arg.s ? arg.s : "(null)");
+                break;
+            default:
+                spec += 'p';
+                snprintf(buf, sizeof(buf), spec.c_str(), arg.p);
+                break;
+            }
+            out += buf;
+        }
+
+        if (record.suppressed) {
+            bool bNewline = !out.empty() && out.back() == '\n';
+            if (bNewline)
+                out.pop_back();
+            snprintf(buf, sizeof(buf), " (x%u suppressed)", record.suppressed);
+            out += buf;
+            if (bNewline)
+                out += '\n';
+        }
+        return out;
+    }
+
+    // prints the counts of sites whose interval has passed without a log carrying them. the
+    // interval is claimed like a log would, so a concurrent log of the site is suppressed instead
+    // of being reported twice. bAll ignores the interval, for Stop
+    void FlushSuppressed(bool bAll)
+    {
+        uint64_t now = AsyncLog::NowMs();
+        for (AsyncLog::Site *pSite = g_sites.load(std::memory_order_acquire); pSite; pSite = pSite->pNext)
+        {
+            if (!pSite->suppressed.load(std::memory_order_relaxed))
+                continue;
+
+            uint64_t next = pSite->nextLogMs.load(std::memory_order_relaxed);
+            if (!bAll && (now < next || !pSite->nextLogMs.compare_exchange_strong(next, now + AsyncLog::SITE_INTERVAL_MS, std::memory_order_relaxed)))
+                continue;
+
+            uint32_t suppressed = pSite->suppressed.exchange(0, std::memory_order_relaxed);
+            if (!suppressed)
+                continue;
+
+            std::string text = pSite->format;
+            if (!text.empty() && text.back() == '\n')
+                text.pop_back();
+            HL_LOG_ERR("[AsyncLog] x%u suppressed: %s\n", suppressed, text.c_str());
+        }
+    }
+
+    void Drain()
+    {
+        Record record;
+        while (Pop(record)) {
+            std::string text = Format(record);
+            HL_LOG_ERR("%s", text.c_str());
+        }
+
+        uint32_t dropped = g_dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped)
+            HL_LOG_ERR("[AsyncLog] queue full, x%u dropped\n", dropped);
+
+        FlushSuppressed(false);
+    }
+
+    void DrainLoop()
+    {
+        while (!g_bStop.load(std::memory_order_acquire)) {
+            Drain();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        Drain();
+    }
+}
+
+
+uint64_t AsyncLog::NowMs()
+{
+    return GetTickCount64();
+}
+
+void AsyncLog::Register(Site &site, const char *format)
+{
+    if (site.registered.exchange(true, std::memory_order_acq_rel))
+        return;
+
+    site.format = format;
+    Site *pHead = g_sites.load(std::memory_order_relaxed);
+    do {
+        site.pNext = pHead;
+    } while (!g_sites.compare_exchange_weak(pHead, &site, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void AsyncLog::Push(Site &site, const char *format, const Arg *args, int nArgs)
+{
+    size_t pos = g_enqueuePos.load(std::memory_order_relaxed);
+    Cell *pCell;
+    while (true)
+    {
+        pCell = &g_cells[pos % QUEUE_SIZE];
+        size_t seq = pCell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (g_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            // full, the consumer is behind. keep the count so the loss shows up in the log
+            g_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = g_enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    Record &record = pCell->record;
+    record.format = format;
+    record.suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+    record.nArgs = nArgs;
+    for (int i = 0; i < nArgs; i++)
+        record.args[i] = args[i];
+
+    pCell->sequence.store(pos + 1, std::memory_order_release);
+}
+
+void AsyncLog::Start()
+{
+    if (g_thread.joinable())
+        return;
+    g_bStop = false;
+    g_thread = std::thread(DrainLoop);
+}
+
+void AsyncLog::Stop()
+{
+    g_bStop = true;
+    if (g_thread.joinable())
+        g_thread.join();
+    FlushSuppressed(true);
+}
@@ -0,0 +1,104 @@
+#ifndef ASYNCLOG_H
+#define ASYNCLOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+
+// logging for the game, render and ingest threads. a call only checks the rate limit of its
+// call site and copies the raw arguments into a lock-free queue, formatting and console output
+// happen on a background thread. string arguments are stored as pointers and must stay valid,
+// use literals.
+#define ASYNC_LOG_ERR(...) \
+    do { \
+        static AsyncLog::Site asyncLogSite; \
+        AsyncLog::Log(asyncLogSite, __VA_ARGS__); \
+    } while (0)
+
+
+namespace AsyncLog
+{
+    static const int MAX_ARGS = 6;
+    // a call site logs at most once per interval, the calls in between are counted. counts that
+    // are not carried by a later log of the site are printed once the interval has passed
+    static const uint64_t SITE_INTERVAL_MS = 1000;
+
+    struct Site
+    {
+        std::atomic<uint64_t> nextLogMs{0};
+        std::atomic<uint32_t> suppressed{0};
+        // sites put themselves into a lock-free list on first use, so the drain thread can
+        // find counts that are still pending
+        std::atomic<bool> registered{false};
+        const char *format = nullptr;
+        Site *pNext = nullptr;
+    };
+
+    struct Arg
+    {
+        enum Type : uint8_t { ARG_INT, ARG_UINT, ARG_DOUBLE, ARG_PTR, ARG_STR };
+        Type type;
+        union {
+            int64_t i;
+            uint64_t u;
+            double d;
+            const void *p;
+            const char *s;
+        };
+    };
+
+    template <typename T>
+    Arg MakeArg(T value)
+    {
+        Arg arg;
+        if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, char*>) {
+            arg.type = Arg::ARG_STR;
+            arg.s = value;
+        } else if constexpr (std::is_pointer_v<T>) {
+            arg.type = Arg::ARG_PTR;
+            arg.p = value;
+        } else if constexpr (std::is_floating_point_v<T>) {
+            arg.type = Arg::ARG_DOUBLE;
+            arg.d = value;
+        } else if constexpr (std::is_enum_v<T> || std::is_signed_v<T>) {
+            arg.type = Arg::ARG_INT;
+            arg.i = static_cast<int64_t>(value);
+        } else {
+            static_assert(std::is_integral_v<T>, "unsupported log argument");
+            arg.type = Arg::ARG_UINT;
+            arg.u = static_cast<uint64_t>(value);
+        }
+        return arg;
+    }
+
+    uint64_t NowMs();
+    void Register(Site &site, const char *format);
+    void Push(Site &site, const char *format, const Arg *args, int nArgs);
+
+    // starts and stops the thread that formats and prints. Stop prints what is still queued
+    // and every pending suppressed count
+    void Start();
+    void Stop();
+
+    template <typename... Args>
+    void Log(Site &site, const char *format, Args... args)
+    {
+        static_assert(sizeof...(Args) <= MAX_ARGS, "too many log arguments");
+
+        if (!site.registered.load(std::memory_order_acquire))
+            Register(site, format);
+
+        uint64_t now = NowMs();
+        uint64_t next = site.nextLogMs.load(std::memory_order_relaxed);
+        if (now < next || !site.nextLogMs.compare_exchange_strong(next, now + SITE_INTERVAL_MS, std::memory_order_relaxed)) {
+            site.suppressed.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        Arg argArray[MAX_ARGS + 1] = { MakeArg(args)... };
+        Push(site, format, argArray, sizeof...(Args));
+    }
+}
+
+#endif
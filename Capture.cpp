@@ -0,0 +1,71 @@
+#include "Capture.h"
+
+#include <emmintrin.h>
+#include <bit>
+
+
+void GameData::AgentSlotState::Update(const AgentCapture &capture, uint64_t tick)
+{
+    using namespace GW2LIB::GW2;
+
+    bool bStill = !hasPos || capture.pos == lastPos;
+    lastPos = capture.pos;
+    hasPos = true;
+
+    if (!bStill) {
+        hasMoved = true;
+        isStatic = false;
+        stillCaptures = 0;
+        return;
+    }
+    stillCaptures++;
+
+    bool bWasStatic = isStatic;
+    if (capture.category == AGENT_CATEGORY_KEYFRAMED && !hasMoved) {
+        isStatic = true;
+    } else if (capture.type == AGENT_TYPE_GADGET || capture.type == AGENT_TYPE_GADGET_ATTACK_TARGET || capture.category == AGENT_CATEGORY_KEYFRAMED) {
+        isStatic = stillCaptures >= STATIC_STILL_CAPTURES;
+    }
+
+    if (isStatic && !bWasStatic)
+        staticSinceTick = tick;
+    if (isStatic)
+        nextCheckTick = tick + STATIC_RECHECK_TICKS;
+}
+
+
+int GameData::DiffSlots(void *const *cur, void *const *prev, size_t count, std::vector<uint32_t> &changed)
+{
+    // pointers per sse vector
+    static const size_t LANES = 16 / sizeof(void*);
+
+    changed.assign((count + 31) / 32, 0);
+
+    size_t i = 0;
+    for (; i + LANES <= count; i += LANES)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i));
+        __m128i eq = _mm_cmpeq_epi32(a, b);
+#ifdef ARCH_64BIT
+        // a 64 bit lane is equal if both halves are
+        eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+        uint32_t diff = ~_mm_movemask_pd(_mm_castsi128_pd(eq)) & 0x3;
+#else
+        uint32_t diff = ~_mm_movemask_ps(_mm_castsi128_ps(eq)) & 0xf;
+#endif
+        // LANES divides 32, so a group never straddles two words
+        changed[i / 32] |= diff << (i % 32);
+    }
+    for (; i < count; i++) {
+        if (cur[i] != prev[i])
+            changed[i / 32] |= 1u << (i % 32);
+    }
+
+    int nChanged = 0;
+    for (uint32_t word : changed) {
+        // portable, POPCNT is not part of the sse2 baseline
+        nChanged += std::popcount(word);
+    }
+    return nChanged;
+}
\ No newline at end of file
@@ -0,0 +1,181 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "gw2lib.h"
+
+#include "d3dx9.h"
+#include <vector>
+#include <algorithm>
+
+
+namespace GameData
+{
+    struct RuntimeLayout;
+
+    // raw per tick data. it is filled on the game thread with as little work as possible
+    // and decoded into GameData by the ingest workers.
+
+    static const size_t CAPTURE_NAME_MAX = 64;
+
+    // objects that fault during capture are skipped for this many ticks
+    static const uint64_t QUARANTINE_TICKS = 120;
+    // ticks between rebuilds of the page cache by the ingest thread
+    static const uint64_t PAGE_CACHE_REBUILD_TICKS = 600;
+
+    struct AgentCapture
+    {
+        // Agent::CAgentBase*, nullptr if the slot is empty
+        void *pAgent = nullptr;
+        GW2LIB::GW2::AgentCategory category = GW2LIB::GW2::AGENT_CATEGORY_CHAR;
+        GW2LIB::GW2::AgentType type = GW2LIB::GW2::AGENT_TYPE_CHAR;
+        int agentId = 0;
+        D3DXVECTOR3 pos = D3DXVECTOR3(0, 0, 0);
+        // false if the agent was skipped by the refresh budget, only pAgent is valid then
+        bool refreshed = false;
+        // agent is in the static slow lane, see AgentSlotState
+        bool isStatic = false;
+        // AgentReadPlan spans that were copied into the raw arena
+        bool hasTransform = false;
+    };
+
+    struct CharacterCapture
+    {
+        enum Span {
+            SPAN_CHARACTER = 1 << 0,
+            SPAN_HEALTH = 1 << 1,
+            SPAN_ENDURANCE = 1 << 2,
+            SPAN_CORESTATS = 1 << 3,
+            SPAN_INVENTORY = 1 << 4,
+            SPAN_BREAKBAR = 1 << 5
+        };
+
+        void *pCharacter = nullptr;
+        // false if the character was skipped by the refresh budget, only pCharacter is valid then
+        bool refreshed = false;
+        int agentId = 0;
+        bool isAlive = false;
+        bool isDowned = false;
+        bool isControlled = false;
+        bool isPlayer = false;
+        bool isInWater = false;
+        bool isMonster = false;
+        bool isMonsterPlayerClone = false;
+        // CharacterReadPlan spans that were copied into the raw arena
+        unsigned spans = 0;
+        // CharClient::CPlayer*, joined with CaptureFrame::players by pointer
+        void *pPlayer = nullptr;
+    };
+
+    struct PlayerCapture
+    {
+        // CharClient::CPlayer*
+        void *pPlayer = nullptr;
+        // names are only read for players the game thread has not seen before
+        bool hasName = false;
+        // raw utf-16 player name, zero terminated
+        wchar_t name[CAPTURE_NAME_MAX];
+    };
+
+    // game objects that are refreshed on every tick regardless of the refresh budget.
+    // computed by the ingest thread from the last decoded tick, both lists are sorted
+    struct RefreshPriority
+    {
+        std::vector<void*> agents;
+        std::vector<void*> chars;
+        // players whose name is still missing on the ingest side
+        std::vector<void*> players;
+        // tick of the capture these were computed from
+        uint64_t decodedTick = 0;
+
+        bool HasAgent(void *p) const { return std::binary_search(agents.begin(), agents.end(), p); }
+        bool HasChar(void *p) const { return std::binary_search(chars.begin(), chars.end(), p); }
+        bool HasPlayer(void *p) const { return std::binary_search(players.begin(), players.end(), p); }
+    };
+
+    struct RefreshBudget
+    {
+        // 0 means no limit
+        int maxEntities = 0;
+        float maxMicroseconds = 0;
+        float priorityRange = 2000.0f;
+    };
+
+    // game thread bookkeeping per agent array slot to find agents that never move.
+    // keyframed agents are assumed static right away, gadgets after a number of still captures.
+    // static agents are only captured again every STATIC_RECHECK_TICKS or when the slot changes.
+    // an agent only leaves the fast lane once a capture from its static period was decoded,
+    // so a dropped frame can not leave it without data until the recheck.
+    static const int STATIC_STILL_CAPTURES = 8;
+    static const uint64_t STATIC_RECHECK_TICKS = 300;
+
+    struct AgentSlotState
+    {
+        D3DXVECTOR3 lastPos = D3DXVECTOR3(0, 0, 0);
+        bool hasPos = false;
+        int stillCaptures = 0;
+        bool hasMoved = false;
+        bool isStatic = false;
+        uint64_t staticSinceTick = 0;
+        uint64_t nextCheckTick = 0;
+
+        bool IsDue(uint64_t tick, uint64_t decodedTick) const { return !isStatic || decodedTick < staticSinceTick || tick >= nextCheckTick; }
+        void Update(const AgentCapture &capture, uint64_t tick);
+    };
+
+    struct CaptureFrame
+    {
+        bool camValid = false;
+        D3DXVECTOR3 camPos = D3DXVECTOR3(0, 0, 0);
+        D3DXVECTOR3 camLookAt = D3DXVECTOR3(0, 0, 0);
+        float fovy = 0;
+
+        // false if the game arrays could not be read. the object lists are cleared then
+        bool objectsValid = false;
+        void *pControlledCharacter = nullptr;
+        void *pAutoSelection = nullptr;
+        void *pHoverSelection = nullptr;
+        void *pLockedSelection = nullptr;
+
+        // one entry per game agent array slot
+        std::vector<AgentCapture> agents;
+        std::vector<CharacterCapture> chars;
+        // contents of CharClient::CContext::m_playerArray
+        std::vector<PlayerCapture> players;
+
+        // read plan staging bytes, one stride per entry of agents or chars
+        std::vector<uint8_t> agentRaw;
+        std::vector<uint8_t> charRaw;
+        size_t agentStride = 0;
+        size_t charStride = 0;
+
+        D3DXVECTOR3 mouseInWorld = D3DXVECTOR3(0, 0, 0);
+        int mapId = 0;
+        int ping = 0;
+        int fps = 0;
+
+        uint64_t tick = 0;
+        // layout set with SetMems this frame was captured with, nullptr for the static layout
+        const RuntimeLayout *pLayout = nullptr;
+        RefreshBudget budget;
+        int entitiesRefreshed = 0;
+        int agentSlotsChanged = 0;
+        int vcallsSaved = 0;
+        float captureMicroseconds = 0;
+        // objects that faulted and were quarantined, skipped because of quarantine, and
+        // faulting or unreadable sub-objects per field
+        int objectFaults = 0;
+        int quarantined = 0;
+        int fieldFaults[GW2LIB::CAPTURE_FIELD_COUNT] = {};
+        int pageCacheMisses = 0;
+
+        const uint8_t *AgentRaw(size_t i) const { return agentRaw.data() + i*agentStride; }
+        const uint8_t *CharRaw(size_t i) const { return charRaw.data() + i*charStride; }
+    };
+
+    // sets bit (i % 32) of word (i / 32) in changed for every slot where cur[i] != prev[i].
+    // both arrays hold count pointers. returns the number of changed slots
+    int DiffSlots(void *const *cur, void *const *prev, size_t count, std::vector<uint32_t> &changed);
+    inline bool IsSlotChanged(const std::vector<uint32_t> &changed, size_t i) { return (changed[i / 32] >> (i % 32)) & 1; }
+}
+
+#endif
@@ -212,8 +212,21 @@ GW2::Attitude Character::GetAttitude() const
 
 
 std::string Character::GetName() const
+{
+    return std::string(GetNameView());
+}
+
+std::string_view Character::GetNameView() const
+{
+    if (m_ptr && m_ptr->pPlayerData)
+        return m_ptr->pPlayerData->name;
+    return std::string_view();
+}
+
+
+int Character::GetStaleTicks() const
 {
     if (m_ptr)
-        return m_ptr->name;
-    return "";
-}
\ No newline at end of file
+        return m_ptr->staleTicks;
+    return 0;
+}
@@ -0,0 +1,305 @@
+#include "DerivedData.h"
+#include "AsyncLog.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+
+// agents per job of the worker pool, derived jobs are cheaper than decoding
+static const size_t DERIVED_GRAIN = 128;
+// hostile characters further away are no threat
+static const float THREAT_RANGE = 2500.0f;
+// characters closer than this on the xy-plane end up in the same cluster
+static const float CLUSTER_CELL_SIZE = 600.0f;
+// draw calls of each esp level of detail, see GW2LIB::SetEspBudget
+static const int ESP_COST_FULL = 4;
+static const int ESP_COST_REDUCED = 2;
+static const int ESP_COST_DOT = 1;
+
+
+static void DeriveDistance(GameData::GameData &data, const GameData::DerivedContext &ctx, size_t begin, size_t end)
+{
+    auto& agents = data.objData.agentDataList;
+    for (size_t i = begin; i < end; i++)
+    {
+        GameData::AgentData *pAgentData = agents[i].get();
+        if (!pAgentData)
+            continue;
+
+        if (ctx.pOwnAgent) {
+            D3DXVECTOR3 diff = pAgentData->pos - ctx.pOwnAgent->pos;
+            pAgentData->distToSelf = D3DXVec3Length(&diff);
+        } else {
+            pAgentData->distToSelf = 0;
+        }
+    }
+}
+
+// needs distToSelf, so it is registered after DeriveDistance
+static void DeriveThreat(GameData::GameData &data, const GameData::DerivedContext &ctx, size_t begin, size_t end)
+{
+    auto& agents = data.objData.agentDataList;
+    int ownLevel = ctx.pOwnCharacter ? ctx.pOwnCharacter->scaledLevel : 0;
+
+    for (size_t i = begin; i < end; i++)
+    {
+        GameData::AgentData *pAgentData = agents[i].get();
+        if (!pAgentData)
+            continue;
+
+        pAgentData->threat = 0;
+        const GameData::CharacterData *pCharData = pAgentData->pCharData;
+        if (!ctx.pOwnAgent || !pCharData || !pCharData->isAlive || pCharData->attitude != GW2LIB::GW2::ATTITUDE_HOSTILE)
+            continue;
+        if (pAgentData->distToSelf >= THREAT_RANGE)
+            continue;
+
+        float threat = 1.0f - pAgentData->distToSelf / THREAT_RANGE;
+        float level = 1.0f + 0.1f * (pCharData->scaledLevel - ownLevel);
+        threat *= level < 0.5f ? 0.5f : level > 2.0f ? 2.0f : level;
+        if (pCharData->maxHealth > 0)
+            threat *= 0.5f + 0.5f * pCharData->currentHealth / pCharData->maxHealth;
+        if (pCharData->isDowned)
+            threat *= 0.25f;
+        if (pCharData->isPlayer)
+            threat *= 2.0f;
+        pAgentData->threat = threat;
+    }
+}
+
+static void DeriveScreenPos(GameData::GameData &data, const GameData::DerivedContext &ctx, size_t begin, size_t end)
+{
+    auto& agents = data.objData.agentDataList;
+    for (size_t i = begin; i < end; i++)
+    {
+        GameData::AgentData *pAgentData = agents[i].get();
+        if (!pAgentData)
+            continue;
+
+        pAgentData->onScreen = false;
+        if (!ctx.hasViewProj)
+            continue;
+
+        D3DXVECTOR4 clip;
+        D3DXVec3Transform(&clip, &pAgentData->pos, &ctx.viewProj);
+        if (clip.w <= 0)
+            continue;
+
+        float x = clip.x / clip.w;
+        float y = clip.y / clip.w;
+        float z = clip.z / clip.w;
+        pAgentData->screenPos.x = (x + 1.0f) * 0.5f * ctx.screenWidth;
+        pAgentData->screenPos.y = (1.0f - y) * 0.5f * ctx.screenHeight;
+        pAgentData->onScreen = x >= -1.0f && x <= 1.0f && y >= -1.0f && y <= 1.0f && z >= 0.0f && z <= 1.0f;
+    }
+}
+
+static uint64_t ClusterCellKey(int x, int y)
+{
+    return static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32 | static_cast<uint32_t>(y);
+}
+
+// living characters in touching cells form a cluster, ids are dense and start at 0
+static void DeriveClusters(GameData::GameData &data, const GameData::DerivedContext &ctx)
+{
+    auto& agents = data.objData.agentDataList;
+
+    std::unordered_map<uint64_t, int> cellCluster;
+    std::vector<std::pair<int, int>> cells;
+    for (auto& pAgentData : agents)
+    {
+        if (!pAgentData)
+            continue;
+        pAgentData->clusterId = -1;
+        if (!pAgentData->pCharData || !pAgentData->pCharData->isAlive)
+            continue;
+
+        int x = static_cast<int>(floor(pAgentData->pos.x / CLUSTER_CELL_SIZE));
+        int y = static_cast<int>(floor(pAgentData->pos.y / CLUSTER_CELL_SIZE));
+        if (cellCluster.emplace(ClusterCellKey(x, y), -1).second)
+            cells.push_back(std::make_pair(x, y));
+    }
+
+    // flood fill over the 8 neighbours of occupied cells
+    int nClusters = 0;
+    std::vector<std::pair<int, int>> stack;
+    for (const auto& cell : cells)
+    {
+        int &id = cellCluster[ClusterCellKey(cell.first, cell.second)];
+        if (id != -1)
+            continue;
+
+        id = nClusters;
+        stack.push_back(cell);
+        while (!stack.empty())
+        {
+            auto c = stack.back();
+            stack.pop_back();
+            for (int dx = -1; dx <= 1; dx++) {
+                for (int dy = -1; dy <= 1; dy++) {
+                    auto it = cellCluster.find(ClusterCellKey(c.first + dx, c.second + dy));
+                    if (it != cellCluster.end() && it->second == -1) {
+                        it->second = nClusters;
+                        stack.push_back(std::make_pair(c.first + dx, c.second + dy));
+                    }
+                }
+            }
+        }
+        nClusters++;
+    }
+
+    for (auto& pAgentData : agents)
+    {
+        if (!pAgentData || !pAgentData->pCharData || !pAgentData->pCharData->isAlive)
+            continue;
+        int x = static_cast<int>(floor(pAgentData->pos.x / CLUSTER_CELL_SIZE));
+        int y = static_cast<int>(floor(pAgentData->pos.y / CLUSTER_CELL_SIZE));
+        pAgentData->clusterId = cellCluster[ClusterCellKey(x, y)];
+    }
+}
+
+
+static float EspImportance(const GameData::GameData &data, const GameData::AgentData *pAgentData)
+{
+    const auto& objData = data.objData;
+    if (pAgentData == objData.ownAgent || pAgentData == objData.lockedSelection ||
+        pAgentData == objData.hoverSelection || pAgentData == objData.autoSelection)
+        return FLT_MAX;
+
+    float importance = 1.0f / (1.0f + pAgentData->distToSelf / 500.0f);
+    const GameData::CharacterData *pCharData = pAgentData->pCharData;
+    if (!pCharData)
+        return importance * 0.5f;
+
+    importance += pAgentData->threat;
+    if (pCharData->attitude == GW2LIB::GW2::ATTITUDE_HOSTILE)
+        importance += 0.5f;
+    if (pCharData->isPlayer)
+        importance *= 1.5f;
+    return importance;
+}
+
+// needs distToSelf, threat and onScreen. every agent on screen gets a dot first, the draw
+// calls left over upgrade the most important ones
+static void DeriveEspLod(GameData::GameData &data, const GameData::DerivedContext &ctx)
+{
+    auto& agents = data.objData.agentDataList;
+
+    std::vector<std::pair<float, GameData::AgentData*>> ranked;
+    for (auto& pAgentData : agents)
+    {
+        if (!pAgentData)
+            continue;
+        // without a viewport there is nothing to go by, so everything counts as visible
+        if (ctx.hasViewProj && !pAgentData->onScreen) {
+            pAgentData->espLod = GW2LIB::ESP_LOD_HIDDEN;
+            continue;
+        }
+        pAgentData->espLod = GW2LIB::ESP_LOD_FULL;
+        if (ctx.espBudget)
+            ranked.push_back(std::make_pair(EspImportance(data, pAgentData.get()), pAgentData.get()));
+    }
+
+    if (!ctx.espBudget)
+        return;
+
+    std::sort(ranked.begin(), ranked.end(), [](const std::pair<float, GameData::AgentData*> &a, const std::pair<float, GameData::AgentData*> &b) {
+        return a.first > b.first;
+    });
+
+    int left = ctx.espBudget - static_cast<int>(ranked.size()) * ESP_COST_DOT;
+    for (size_t i = 0; i < ranked.size(); i++)
+    {
+        GameData::AgentData *pAgentData = ranked[i].second;
+        if (left < 0 && static_cast<int>(i) >= ctx.espBudget) {
+            pAgentData->espLod = GW2LIB::ESP_LOD_HIDDEN;
+        } else if (left >= ESP_COST_FULL - ESP_COST_DOT) {
+            pAgentData->espLod = GW2LIB::ESP_LOD_FULL;
+            left -= ESP_COST_FULL - ESP_COST_DOT;
+        } else if (left >= ESP_COST_REDUCED - ESP_COST_DOT) {
+            pAgentData->espLod = GW2LIB::ESP_LOD_REDUCED;
+            left -= ESP_COST_REDUCED - ESP_COST_DOT;
+        } else {
+            pAgentData->espLod = GW2LIB::ESP_LOD_DOT;
+        }
+    }
+}
+
+
+static void RunUserJob(const GameData::UserDerivedJob &job, size_t begin, size_t end)
+{
+    __try {
+        job.run(begin, end);
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        ASYNC_LOG_ERR("[DerivedJobs] Exception in %s\n", job.name);
+    }
+}
+
+static void FinishUserJob(const GameData::UserDerivedJob &job)
+{
+    __try {
+        job.finish();
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        ASYNC_LOG_ERR("[DerivedJobs] Exception in %s\n", job.name);
+    }
+}
+
+
+void GameData::DerivedJobs::Register(const DerivedJob &job)
+{
+    m_jobs.push_back(job);
+}
+
+void GameData::DerivedJobs::RegisterDefaults()
+{
+    Register({ "distance", DeriveDistance, nullptr });
+    Register({ "threat", DeriveThreat, nullptr });
+    Register({ "screen", DeriveScreenPos, nullptr });
+    Register({ "cluster", nullptr, DeriveClusters });
+    Register({ "esplod", nullptr, DeriveEspLod });
+}
+
+void GameData::DerivedJobs::RegisterUser(const UserDerivedJob &job)
+{
+    std::lock_guard<std::mutex> lock(m_userMutex);
+    m_userJobsNew.push_back(job);
+}
+
+void GameData::DerivedJobs::Run(GameData &data, JobPool &pool, const DerivedContext &ctx)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_userMutex);
+        m_userJobs.insert(m_userJobs.end(), m_userJobsNew.begin(), m_userJobsNew.end());
+        m_userJobsNew.clear();
+    }
+
+    // one pass over each range runs all jobs while the agents are in cache
+    pool.ParallelFor(data.objData.agentDataList.size(), DERIVED_GRAIN, [&](size_t begin, size_t end) {
+        for (const auto& job : m_jobs) {
+            if (job.run)
+                job.run(data, ctx, begin, end);
+        }
+    });
+
+    for (const auto& job : m_jobs) {
+        if (job.finish)
+            job.finish(data, ctx);
+    }
+
+    if (m_userJobs.empty())
+        return;
+
+    // user jobs may read every agent, so they get their own pass once all built-in values are final
+    pool.ParallelFor(data.objData.agentDataList.size(), DERIVED_GRAIN, [&](size_t begin, size_t end) {
+        for (const auto& job : m_userJobs) {
+            if (job.run)
+                RunUserJob(job, begin, end);
+        }
+    });
+
+    for (const auto& job : m_userJobs) {
+        if (job.finish)
+            FinishUserJob(job);
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef DERIVEDDATA_H
+#define DERIVEDDATA_H
+
+#include "GameData.h"
+#include "JobPool.h"
+
+#include "d3dx9.h"
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+
+namespace GameData
+{
+    // inputs shared by all derived jobs of one tick
+    struct DerivedContext
+    {
+        const AgentData *pOwnAgent = nullptr;
+        const CharacterData *pOwnCharacter = nullptr;
+        // camera of the tick, screen positions are only derived if a viewport is known
+        bool hasViewProj = false;
+        D3DXMATRIX viewProj;
+        float screenWidth = 0;
+        float screenHeight = 0;
+        // draw calls the esp may spend per frame, 0 for no limit
+        int espBudget = 0;
+    };
+
+    // computes per agent values after decoding. run is called for ranges of agentDataList on
+    // the worker pool and may only write to the agents of its range, finish is called once
+    // on the ingest thread after all ranges are done. either may be nullptr
+    struct DerivedJob
+    {
+        const char *name;
+        void (*run)(GameData &data, const DerivedContext &ctx, size_t begin, size_t end);
+        void (*finish)(GameData &data, const DerivedContext &ctx);
+    };
+
+    // job registered through GW2LIB::RegisterDerivedJob. it reads the tick through the public
+    // getters, so it only gets its range. faults in it are logged and do not stop decoding
+    struct UserDerivedJob
+    {
+        const char *name;
+        void (*run)(size_t begin, size_t end);
+        void (*finish)();
+    };
+
+    class DerivedJobs
+    {
+    public:
+        // jobs are registered once at startup and run in order every tick
+        void Register(const DerivedJob &job);
+        void RegisterDefaults();
+        // can be called from any thread, the job runs after the built-in ones from the next tick on
+        void RegisterUser(const UserDerivedJob &job);
+
+        void Run(GameData &data, JobPool &pool, const DerivedContext &ctx);
+
+    private:
+        std::vector<DerivedJob> m_jobs;
+        std::vector<UserDerivedJob> m_userJobs;
+        // registered since the last Run
+        std::vector<UserDerivedJob> m_userJobsNew;
+        std::mutex m_userMutex;
+    };
+}
+
+#endif
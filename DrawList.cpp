@@ -0,0 +1,267 @@
+#include "DrawList.h"
+
+#include <cstdarg>
+#include <algorithm>
+
+
+DrawList::Cmd &DrawList::Add(Type type, D3DCOLOR color)
+{
+    m_cmds.emplace_back();
+    Cmd &cmd = m_cmds.back();
+    cmd.type = type;
+    cmd.color = color;
+    return cmd;
+}
+
+void DrawList::Line(float x, float y, float x2, float y2, D3DCOLOR color)
+{
+    Cmd &cmd = Add(CMD_LINE, color);
+    cmd.v[0] = x;
+    cmd.v[1] = y;
+    cmd.v[2] = x2;
+    cmd.v[3] = y2;
+}
+
+void DrawList::LineProjected(const D3DXVECTOR3 &pos1, const D3DXVECTOR3 &pos2, D3DCOLOR color)
+{
+    Cmd &cmd = Add(CMD_LINE_PROJECTED, color);
+    cmd.v[0] = pos1.x;
+    cmd.v[1] = pos1.y;
+    cmd.v[2] = pos1.z;
+    cmd.v[3] = pos2.x;
+    cmd.v[4] = pos2.y;
+    cmd.v[5] = pos2.z;
+}
+
+void DrawList::Rect(float x, float y, float w, float h, D3DCOLOR color, bool bFilled)
+{
+    Cmd &cmd = Add(bFilled ? CMD_RECT_FILLED : CMD_RECT, color);
+    cmd.v[0] = x;
+    cmd.v[1] = y;
+    cmd.v[2] = w;
+    cmd.v[3] = h;
+}
+
+void DrawList::Circle(float mx, float my, float r, D3DCOLOR color, bool bFilled)
+{
+    Cmd &cmd = Add(bFilled ? CMD_CIRCLE_FILLED : CMD_CIRCLE, color);
+    cmd.v[0] = mx;
+    cmd.v[1] = my;
+    cmd.v[2] = r;
+}
+
+void DrawList::Primitive(const hl::VertexBuffer *vb, const hl::IndexBuffer *ib, D3DPRIMITIVETYPE type, const D3DXMATRIX &world, float radius)
+{
+    Cmd &cmd = Add(CMD_PRIMITIVE, 0);
+    cmd.primType = type;
+    cmd.v[0] = radius;
+    cmd.p = vb;
+    cmd.p2 = ib;
+    cmd.index = static_cast<uint32_t>(m_matrices.size());
+    m_matrices.push_back(world);
+}
+
+void DrawList::Primitive(const hl::VertexBuffer *vb, const hl::IndexBuffer *ib, D3DPRIMITIVETYPE type, const D3DXMATRIX &world, float radius, D3DCOLOR color)
+{
+    Primitive(vb, ib, type, world, radius);
+    m_cmds.back().type = CMD_PRIMITIVE_COLORED;
+    m_cmds.back().color = color;
+}
+
+void DrawList::Shape(ShapeType type, float param, const D3DXMATRIX &world, D3DCOLOR color)
+{
+    Cmd &cmd = Add(CMD_SHAPE, color);
+    cmd.shape = type;
+    cmd.v[0] = param;
+    cmd.index = static_cast<uint32_t>(m_matrices.size());
+    m_matrices.push_back(world);
+}
+
+void DrawList::Texture(const hl::Texture *pTexture, float x, float y, float w, float h)
+{
+    Cmd &cmd = Add(CMD_TEXTURE, 0);
+    cmd.p = pTexture;
+    cmd.v[0] = x;
+    cmd.v[1] = y;
+    cmd.v[2] = w;
+    cmd.v[3] = h;
+}
+
+void DrawList::Text(const hl::Font *pFont, float x, float y, D3DCOLOR color, const char *text)
+{
+    Cmd &cmd = Add(CMD_TEXT, color);
+    cmd.p = pFont;
+    cmd.v[0] = x;
+    cmd.v[1] = y;
+    cmd.index = static_cast<uint32_t>(m_text.size());
+    m_text += text;
+    m_text += '\0';
+}
+
+void DrawList::Label(const hl::Font *pFont, float size, float x, float y, float priority, D3DCOLOR color, const char *text)
+{
+    Cmd &cmd = Add(CMD_LABEL, color);
+    cmd.p = pFont;
+    cmd.v[0] = x;
+    cmd.v[1] = y;
+    cmd.v[2] = size;
+    cmd.v[3] = priority;
+    cmd.index = static_cast<uint32_t>(m_text.size());
+    m_text += text;
+    m_text += '\0';
+}
+
+void DrawList::TextProjected(const hl::Font *pFont, const D3DXVECTOR3 &pos, float offX, float offY, D3DCOLOR color, const char *text)
+{
+    Cmd &cmd = Add(CMD_TEXT_PROJECTED, color);
+    cmd.p = pFont;
+    cmd.v[0] = pos.x;
+    cmd.v[1] = pos.y;
+    cmd.v[2] = pos.z;
+    cmd.v[3] = offX;
+    cmd.v[4] = offY;
+    cmd.index = static_cast<uint32_t>(m_text.size());
+    m_text += text;
+    m_text += '\0';
+}
+
+void DrawList::Clear()
+{
+    // keeps the capacity, lists are refilled at the same size most of the time
+    m_cmds.clear();
+    m_matrices.clear();
+    m_text.clear();
+}
+
+
+static void DrawFontFormat(hl::Drawer *pDrawer, const hl::Font *pFont, float x, float y, D3DCOLOR color, const char *format, ...)
+{
+    va_list vl;
+    va_start(vl, format);
+    pDrawer->DrawFont(pFont, x, y, color, format, vl);
+    va_end(vl);
+}
+
+void DrawList::Submit(hl::Drawer *pDrawer, PrimitiveBatch *pBatch, LabelPlacer *pLabels) const
+{
+    for (const auto& cmd : m_cmds)
+    {
+        const float *v = cmd.v;
+        switch (cmd.type)
+        {
+        case CMD_LINE:
+            pDrawer->DrawLine(v[0], v[1], v[2], v[3], cmd.color);
+            break;
+        case CMD_LINE_PROJECTED:
+            pBatch->AddLine(D3DXVECTOR3(v[0], v[1], v[2]), D3DXVECTOR3(v[3], v[4], v[5]), cmd.color);
+            break;
+        case CMD_RECT:
+            pDrawer->DrawRect(v[0], v[1], v[2], v[3], cmd.color);
+            break;
+        case CMD_RECT_FILLED:
+            pDrawer->DrawRectFilled(v[0], v[1], v[2], v[3], cmd.color);
+            break;
+        case CMD_CIRCLE:
+            pDrawer->DrawCircle(v[0], v[1], v[2], cmd.color);
+            break;
+        case CMD_CIRCLE_FILLED:
+            pDrawer->DrawCircleFilled(v[0], v[1], v[2], cmd.color);
+            break;
+        case CMD_PRIMITIVE:
+            pBatch->Add(static_cast<const hl::VertexBuffer*>(cmd.p), static_cast<const hl::IndexBuffer*>(cmd.p2), cmd.primType, m_matrices[cmd.index], v[0]);
+            break;
+        case CMD_PRIMITIVE_COLORED:
+            pBatch->Add(static_cast<const hl::VertexBuffer*>(cmd.p), static_cast<const hl::IndexBuffer*>(cmd.p2), cmd.primType, m_matrices[cmd.index], v[0], cmd.color);
+            break;
+        case CMD_SHAPE:
+            // the level of detail follows the current camera
+            pBatch->AddShape(cmd.shape, v[0], m_matrices[cmd.index], cmd.color);
+            break;
+        case CMD_TEXTURE:
+            pDrawer->DrawTexture(static_cast<const hl::Texture*>(cmd.p), v[0], v[1], v[2], v[3]);
+            break;
+        case CMD_TEXT:
+            // the text was formatted when it was recorded
+            DrawFontFormat(pDrawer, static_cast<const hl::Font*>(cmd.p), v[0], v[1], cmd.color, "%s", m_text.c_str() + cmd.index);
+            break;
+        case CMD_LABEL:
+            pLabels->Add(static_cast<const hl::Font*>(cmd.p), v[2], v[0], v[1], v[3], cmd.color, m_text.c_str() + cmd.index);
+            break;
+        case CMD_TEXT_PROJECTED:
+        {
+            D3DXVECTOR3 screen;
+            pDrawer->Project(D3DXVECTOR3(v[0], v[1], v[2]), screen);
+            if (pDrawer->IsInfrontCam(screen))
+                DrawFontFormat(pDrawer, static_cast<const hl::Font*>(cmd.p), screen.x + v[3], screen.y + v[4], cmd.color, "%s", m_text.c_str() + cmd.index);
+            break;
+        }
+        }
+    }
+}
+
+
+static thread_local DrawList *t_pRecording = nullptr;
+
+DrawList *DrawList::GetRecording()
+{
+    return t_pRecording;
+}
+
+void DrawList::SetRecording(DrawList *pList)
+{
+    t_pRecording = pList;
+}
+
+
+void DrawQueue::Publish()
+{
+    int prev = m_middle.exchange(m_back | FRESH);
+    m_back = prev & ~FRESH;
+}
+
+const DrawList *DrawQueue::Acquire()
+{
+    if (m_middle.load() & FRESH) {
+        int prev = m_middle.exchange(m_front);
+        m_front = prev & ~FRESH;
+    }
+    return &m_lists[m_front];
+}
+
+
+// keeps the queue of a thread and retires it when the thread exits
+struct ThreadDrawQueue
+{
+    std::shared_ptr<DrawQueue> pQueue;
+
+    ~ThreadDrawQueue()
+    {
+        if (pQueue)
+            pQueue->m_bRetired = true;
+    }
+};
+
+static thread_local ThreadDrawQueue t_drawQueue;
+
+DrawQueue *DrawQueues::GetThreadQueue()
+{
+    if (!t_drawQueue.pQueue) {
+        t_drawQueue.pQueue = std::make_shared<DrawQueue>();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queues.push_back(t_drawQueue.pQueue);
+    }
+    return t_drawQueue.pQueue.get();
+}
+
+void DrawQueues::Submit(hl::Drawer *pDrawer, PrimitiveBatch *pBatch, LabelPlacer *pLabels)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_queues.erase(std::remove_if(m_queues.begin(), m_queues.end(), [](const std::shared_ptr<DrawQueue> &pQueue) {
+        return pQueue->m_bRetired.load();
+    }), m_queues.end());
+
+    for (const auto& pQueue : m_queues) {
+        pQueue->Acquire()->Submit(pDrawer, pBatch, pLabels);
+    }
+}
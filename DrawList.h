@@ -0,0 +1,131 @@
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+#include "PrimitiveBatch.h"
+#include "LabelPlacer.h"
+
+#include "hacklib/Drawer.h"
+
+#include "d3dx9.h"
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+// draw calls recorded for submission on the render thread. fonts, textures and buffers are
+// stored as pointers and must outlive the list
+class DrawList
+{
+public:
+    void Line(float x, float y, float x2, float y2, D3DCOLOR color);
+    void LineProjected(const D3DXVECTOR3 &pos1, const D3DXVECTOR3 &pos2, D3DCOLOR color);
+    void Rect(float x, float y, float w, float h, D3DCOLOR color, bool bFilled);
+    void Circle(float mx, float my, float r, D3DCOLOR color, bool bFilled);
+    // radius bounds the primitive around its origin, see PrimitiveBatch
+    void Primitive(const hl::VertexBuffer *vb, const hl::IndexBuffer *ib, D3DPRIMITIVETYPE type, const D3DXMATRIX &world, float radius);
+    void Primitive(const hl::VertexBuffer *vb, const hl::IndexBuffer *ib, D3DPRIMITIVETYPE type, const D3DXMATRIX &world, float radius, D3DCOLOR color);
+    void Shape(ShapeType type, float param, const D3DXMATRIX &world, D3DCOLOR color);
+    void Texture(const hl::Texture *pTexture, float x, float y, float w, float h);
+    void Text(const hl::Font *pFont, float x, float y, D3DCOLOR color, const char *text);
+    // placed together with the other labels of the frame when submitted
+    void Label(const hl::Font *pFont, float size, float x, float y, float priority, D3DCOLOR color, const char *text);
+    // projected again on every submit, offset in pixels
+    void TextProjected(const hl::Font *pFont, const D3DXVECTOR3 &pos, float offX, float offY, D3DCOLOR color, const char *text);
+
+    void Clear();
+    bool IsEmpty() const { return m_cmds.empty(); }
+    size_t GetSize() const { return m_cmds.size(); }
+
+    // projected lines, primitives and shapes go through pBatch, labels to pLabels
+    void Submit(hl::Drawer *pDrawer, PrimitiveBatch *pBatch, LabelPlacer *pLabels) const;
+
+    // list the draw functions of the calling thread record into, nullptr to draw directly
+    static DrawList *GetRecording();
+    static void SetRecording(DrawList *pList);
+
+private:
+    enum Type : uint8_t
+    {
+        CMD_LINE,
+        CMD_LINE_PROJECTED,
+        CMD_RECT,
+        CMD_RECT_FILLED,
+        CMD_CIRCLE,
+        CMD_CIRCLE_FILLED,
+        CMD_PRIMITIVE,
+        CMD_PRIMITIVE_COLORED,
+        CMD_SHAPE,
+        CMD_TEXTURE,
+        CMD_TEXT,
+        CMD_TEXT_PROJECTED,
+        CMD_LABEL
+    };
+
+    struct Cmd
+    {
+        Type type;
+        ShapeType shape;
+        D3DPRIMITIVETYPE primType;
+        D3DCOLOR color;
+        float v[6];
+        // font, texture or vertex buffer and index buffer
+        const void *p;
+        const void *p2;
+        // offset into m_matrices or m_text
+        uint32_t index;
+    };
+
+    Cmd &Add(Type type, D3DCOLOR color);
+
+    std::vector<Cmd> m_cmds;
+    std::vector<D3DXMATRIX> m_matrices;
+    // zero terminated strings of the text commands
+    std::string m_text;
+};
+
+
+// triple buffered lists between one producer thread and the render thread. neither side
+// waits for the other, the render thread always sees the newest complete list
+class DrawQueue
+{
+public:
+    // producer
+    DrawList *GetBack() { return &m_lists[m_back]; }
+    void Publish();
+
+    // render thread
+    const DrawList *Acquire();
+
+    // set when the producer thread exits
+    std::atomic<bool> m_bRetired{false};
+
+private:
+    static const int FRESH = 4;
+
+    DrawList m_lists[3];
+    int m_back = 0;
+    int m_front = 1;
+    // index of the list in between, or'ed with FRESH when the producer put a new one there
+    std::atomic<int> m_middle{2};
+};
+
+
+// queues of all threads that ever published a draw list
+class DrawQueues
+{
+public:
+    // queue of the calling thread, registered on first use
+    DrawQueue *GetThreadQueue();
+    // draws the newest list of every queue. render thread
+    void Submit(hl::Drawer *pDrawer, PrimitiveBatch *pBatch, LabelPlacer *pLabels);
+
+private:
+    // only held to register threads and by the render thread, never while publishing
+    std::mutex m_mutex;
+    std::vector<std::shared_ptr<DrawQueue>> m_queues;
+};
+
+#endif
@@ -1,34 +1,22 @@
 #include "main.h"
-#include <thread>
-
-
-static const int CIRCLE_RES = 64;
-static const hl::VertexBuffer *vbCircle;
 
 
 bool InitEsp()
 {
+    // the drawer gets its device in the first present
     int c = 0;
     auto pDrawer = GetMain()->GetDrawer(false);
     while (!pDrawer) {
-        if (c++ > 100) {
+        if (c++ > 10) {
             //g_pCon->printf("[GW2LIB::EnableEsp] waiting for drawer timed out\n");
             return false;
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        GW2LIB::WaitForFrame(100);
         pDrawer = GetMain()->GetDrawer(false);
     }
 
-    std::vector<hl::VERTEX_3D_COL> verts;
-    verts.resize(CIRCLE_RES+1);
-    for (size_t i = 0; i < verts.size(); i++) {
-        verts[i].x = cos(D3DX_PI*((CIRCLE_RES-i)/(CIRCLE_RES/2.0f)));
-        verts[i].y = sin(D3DX_PI*((CIRCLE_RES-i)/(CIRCLE_RES/2.0f)));
-        verts[i].z = 0;
-    }
-
-    vbCircle = pDrawer->AllocVertexBuffer(verts);
-    if (vbCircle)
+    // nothing is drawn before gw2lib_main, so the cache is not used by the render thread yet
+    if (GetMain()->GetPrimitiveBatch()->GetShapeCache()->Prebuild(pDrawer))
         return true;
 
     //g_pCon->printf("[InitEsp] could not init esp data\n");
@@ -36,14 +24,97 @@ bool InitEsp()
 }
 
 
+// unit shape scaled by r, turned by rot around the z-axis and moved to pos
+static void DrawShapeProjected(ShapeType type, float param, GW2LIB::Vector3 pos, float r, float rot, DWORD color)
+{
+    D3DXMATRIX scale, rotate, translate;
+    D3DXMatrixScaling(&scale, r, r, r);
+    D3DXMatrixRotationZ(&rotate, rot);
+    D3DXMatrixTranslation(&translate, pos.x, pos.y, pos.z);
+
+    if (auto pList = DrawList::GetRecording()) {
+        pList->Shape(type, param, scale*rotate*translate, color);
+        return;
+    }
+
+    const auto pDrawer = GetMain()->GetDrawer(true);
+    if (pDrawer) {
+        GetMain()->GetPrimitiveBatch()->AddShape(type, param, scale*rotate*translate, color);
+    }
+}
+
+
 void GW2LIB::EnableEsp(void (*cbRender)())
 {
     GetMain()->SetRenderCallback(cbRender);
 }
 
 
+void GW2LIB::SetEspRecordRate(float hz)
+{
+    GetMain()->SetEspRecordRate(hz);
+}
+
+
+void GW2LIB::EnableDepthSorting(bool enable)
+{
+    GetMain()->SetDepthSort(enable);
+}
+
+GW2LIB::DrawStats GW2LIB::GetDrawStats()
+{
+    return GetMain()->GetDrawStats();
+}
+
+void GW2LIB::SetEspBudget(int maxDrawCalls, float maxMicroseconds)
+{
+    GetMain()->SetEspBudget(maxDrawCalls, maxMicroseconds);
+}
+
+
+// recording that was active when BeginDrawList was called, e.g. the esp callback with
+// SetEspRecordRate. it continues after PublishDrawList
+static thread_local DrawList *t_pOuterRecording = nullptr;
+
+void GW2LIB::BeginDrawList()
+{
+    DrawList *pList = GetMain()->GetDrawQueues()->GetThreadQueue()->GetBack();
+    DrawList *pCurrent = DrawList::GetRecording();
+    if (pCurrent != pList)
+        t_pOuterRecording = pCurrent;
+    pList->Clear();
+    DrawList::SetRecording(pList);
+}
+
+void GW2LIB::PublishDrawList()
+{
+    DrawList *pCurrent = DrawList::GetRecording();
+    if (!pCurrent)
+        return;
+
+    // the outer recording is not ours to publish
+    auto pQueue = GetMain()->GetDrawQueues()->GetThreadQueue();
+    if (pCurrent == pQueue->GetBack()) {
+        pQueue->Publish();
+        DrawList::SetRecording(t_pOuterRecording);
+        t_pOuterRecording = nullptr;
+    }
+}
+
+void GW2LIB::ClearDrawList()
+{
+    BeginDrawList();
+    PublishDrawList();
+}
+
+
 void GW2LIB::DrawLine(float x, float y, float x2, float y2, DWORD color)
 {
+    if (auto pList = DrawList::GetRecording()) {
+        pList->Line(x, y, x2, y2, color);
+        return;
+    }
+
     const auto pDrawer = GetMain()->GetDrawer(true);
     if (pDrawer) {
         pDrawer->DrawLine(x, y, x2, y2, color);
@@ -52,14 +123,24 @@ void GW2LIB::DrawLine(float x, float y, float x2, float y2, DWORD color)
 
 void GW2LIB::DrawLineProjected(Vector3 pos1, Vector3 pos2, DWORD color)
 {
+    if (auto pList = DrawList::GetRecording()) {
+        pList->LineProjected(D3DXVECTOR3(pos1.x,pos1.y,pos1.z), D3DXVECTOR3(pos2.x,pos2.y,pos2.z), color);
+        return;
+    }
+
     const auto pDrawer = GetMain()->GetDrawer(true);
     if (pDrawer) {
-        pDrawer->DrawLineProjected(D3DXVECTOR3(pos1.x,pos1.y,pos1.z), D3DXVECTOR3(pos2.x,pos2.y,pos2.z), color);
+        GetMain()->GetPrimitiveBatch()->AddLine(D3DXVECTOR3(pos1.x,pos1.y,pos1.z), D3DXVECTOR3(pos2.x,pos2.y,pos2.z), color);
     }
 }
 
 void GW2LIB::DrawRect(float x, float y, float w, float h, DWORD color)
 {
+    if (auto pList = DrawList::GetRecording()) {
+        pList->Rect(x, y, w, h, color, false);
+        return;
+    }
+
     const auto pDrawer = GetMain()->GetDrawer(true);
     if (pDrawer) {
         pDrawer->DrawRect(x, y, w, h, color);
@@ -68,6 +149,11 @@ void GW2LIB::DrawRect(float x, float y, float w, float h, DWORD color)
 
 void GW2LIB::DrawRectFilled(float x, float y, float w, float h, DWORD color)
 {
+    if (auto pList = DrawList::GetRecording()) {
+        pList->Rect(x, y, w, h, color, true);
+        return;
+    }
+
     const auto pDrawer = GetMain()->GetDrawer(true);
     if (pDrawer) {
         pDrawer->DrawRectFilled(x, y, w, h, color);
@@ -76,6 +162,11 @@ void GW2LIB::DrawRectFilled(float x, float y, float w, float h, DWORD color)
 
 void GW2LIB::DrawCircle(float mx, float my, float r, DWORD color)
 {
+    if (auto pList = DrawList::GetRecording()) {
+        pList->Circle(mx, my, r, color, false);
+        return;
+    }
+
     const auto pDrawer = GetMain()->GetDrawer(true);
     if (pDrawer) {
         pDrawer->DrawCircle(mx, my, r, color);
@@ -84,6 +175,11 @@ void GW2LIB::DrawCircle(float mx, float my, float r, DWORD color)
 
 void GW2LIB::DrawCircleFilled(float mx, float my, float r,  DWORD color)
 {
+    if (auto pList = DrawList::GetRecording()) {
+        pList->Circle(mx, my, r, color, true);
+        return;
+    }
+
     const auto pDrawer = GetMain()->GetDrawer(true);
     if (pDrawer) {
         pDrawer->DrawCircleFilled(mx, my, r, color);
@@ -92,24 +188,29 @@ void GW2LIB::DrawCircleFilled(float mx, float my, float r,  DWORD color)
 
 void GW2LIB::DrawCircleProjected(Vector3 pos, float r, DWORD color)
 {
-    const auto pDrawer = GetMain()->GetDrawer(true);
-    if (pDrawer) {
-        D3DXMATRIX scale, translate;
-        D3DXMatrixScaling(&scale, r, r, r);
-        D3DXMatrixTranslation(&translate, pos.x, pos.y, pos.z);
-        pDrawer->DrawPrimitive(vbCircle, nullptr, D3DPT_LINESTRIP, scale*translate, color);
-    }
+    DrawShapeProjected(SHAPE_CIRCLE, 0, pos, r, 0, color);
 }
 
 void GW2LIB::DrawCircleFilledProjected(Vector3 pos, float r, DWORD color)
 {
-    const auto pDrawer = GetMain()->GetDrawer(true);
-    if (pDrawer) {
-        D3DXMATRIX scale, translate;
-        D3DXMatrixScaling(&scale, r, r, r);
-        D3DXMatrixTranslation(&translate, pos.x, pos.y, pos.z);
-        pDrawer->DrawPrimitive(vbCircle, nullptr, D3DPT_TRIANGLEFAN, scale*translate, color);
-    }
+    DrawShapeProjected(SHAPE_DISC, 0, pos, r, 0, color);
+}
+
+void GW2LIB::DrawRingProjected(Vector3 pos, float r, float width, DWORD color)
+{
+    if (r <= 0)
+        return;
+    DrawShapeProjected(SHAPE_RING, width < r ? (r - width) / r : 0, pos, r, 0, color);
+}
+
+void GW2LIB::DrawArcProjected(Vector3 pos, float r, float rot, float angle, DWORD color)
+{
+    DrawShapeProjected(SHAPE_ARC, angle, pos, r, rot, color);
+}
+
+void GW2LIB::DrawConeProjected(Vector3 pos, float r, float rot, float angle, DWORD color)
+{
+    DrawShapeProjected(SHAPE_CONE, angle, pos, r, rot, color);
 }
 
 
@@ -177,6 +278,12 @@ bool GW2LIB::Texture::Init(const void *buffer, size_t size)
 
 void GW2LIB::Texture::Draw(float x, float y, float w, float h) const
 {
+    if (auto pList = DrawList::GetRecording()) {
+        if (m_ptr)
+            pList->Texture(reinterpret_cast<const hl::Texture*>(m_ptr), x, y, w, h);
+        return;
+    }
+
     const auto pDrawer = GetMain()->GetDrawer(true);
     if (pDrawer && m_ptr)
         pDrawer->DrawTexture(reinterpret_cast<const hl::Texture*>(m_ptr), x, y, w, h);
@@ -186,6 +293,7 @@ void GW2LIB::Texture::Draw(float x, float y, float w, float h) const
 GW2LIB::Font::Font()
 {
     m_ptr = nullptr;
+    m_size = 0;
 }
 
 bool GW2LIB::Font::Init(int size, std::string name)
@@ -193,6 +301,7 @@ bool GW2LIB::Font::Init(int size, std::string name)
     auto pDrawer = GetMain()->GetDrawer(false);
     if (pDrawer) {
         m_ptr = reinterpret_cast<const void*>(pDrawer->AllocFont(name, size));
+        m_size = size;
         if (m_ptr)
             return true;
     }
@@ -204,6 +313,17 @@ void GW2LIB::Font::Draw(float x, float y, DWORD color, std::string format, ...)
     va_list vl;
     va_start(vl, format);
 
+    if (auto pList = DrawList::GetRecording()) {
+        // formatted now, the arguments are gone when the list is drawn
+        if (m_ptr) {
+            char text[1024];
+            vsnprintf(text, sizeof(text), format.c_str(), vl);
+            pList->Text(reinterpret_cast<const hl::Font*>(m_ptr), x, y, color, text);
+        }
+        va_end(vl);
+        return;
+    }
+
     const auto pDrawer = GetMain()->GetDrawer(true);
     if (pDrawer && m_ptr)
         pDrawer->DrawFont(reinterpret_cast<const hl::Font*>(m_ptr), x, y, color, format, vl);
@@ -211,11 +331,59 @@ void GW2LIB::Font::Draw(float x, float y, DWORD color, std::string format, ...)
     va_end(vl);
 }
 
+void GW2LIB::Font::DrawProjected(Vector3 pos, float offX, float offY, DWORD color, std::string format, ...) const
+{
+    va_list vl;
+    va_start(vl, format);
+
+    if (auto pList = DrawList::GetRecording()) {
+        if (m_ptr) {
+            char text[1024];
+            vsnprintf(text, sizeof(text), format.c_str(), vl);
+            pList->TextProjected(reinterpret_cast<const hl::Font*>(m_ptr), D3DXVECTOR3(pos.x,pos.y,pos.z), offX, offY, color, text);
+        }
+        va_end(vl);
+        return;
+    }
+
+    const auto pDrawer = GetMain()->GetDrawer(true);
+    if (pDrawer && m_ptr) {
+        D3DXVECTOR3 screen;
+        pDrawer->Project(D3DXVECTOR3(pos.x,pos.y,pos.z), screen);
+        if (pDrawer->IsInfrontCam(screen))
+            pDrawer->DrawFont(reinterpret_cast<const hl::Font*>(m_ptr), screen.x + offX, screen.y + offY, color, format, vl);
+    }
+
+    va_end(vl);
+}
+
+void GW2LIB::Font::QueueLabel(float x, float y, float priority, DWORD color, std::string format, ...) const
+{
+    if (!m_ptr)
+        return;
+
+    char text[1024];
+    va_list vl;
+    va_start(vl, format);
+    vsnprintf(text, sizeof(text), format.c_str(), vl);
+    va_end(vl);
+
+    if (auto pList = DrawList::GetRecording()) {
+        pList->Label(reinterpret_cast<const hl::Font*>(m_ptr), static_cast<float>(m_size), x, y, priority, color, text);
+        return;
+    }
+
+    if (GetMain()->GetDrawer(true))
+        GetMain()->GetLabelPlacer()->Add(reinterpret_cast<const hl::Font*>(m_ptr), static_cast<float>(m_size), x, y, priority, color, text);
+}
+
 
 struct PrimitiveDiffuseMesh {
     const hl::VertexBuffer *vertBuffer;
     const hl::IndexBuffer *indBuffer;
     D3DPRIMITIVETYPE type;
+    // distance of the farthest vertex from the origin, for culling
+    float radius;
     std::vector<D3DXMATRIX> transforms;
 };
 
@@ -238,12 +406,17 @@ bool GW2LIB::PrimitiveDiffuse::Init(std::vector<std::pair<Vector3,DWORD>> vertic
 
         std::vector<hl::VERTEX_3D_DIF> verts;
         verts.resize(vertices.size());
+        float radius2 = 0;
         for (size_t i = 0; i < vertices.size(); i++) {
             verts[i].x = vertices[i].first.x;
             verts[i].y = vertices[i].first.y;
             verts[i].z = vertices[i].first.z;
             verts[i].color = vertices[i].second;
+            float dist2 = verts[i].x*verts[i].x + verts[i].y*verts[i].y + verts[i].z*verts[i].z;
+            if (dist2 > radius2)
+                radius2 = dist2;
         }
+        m_ptr->radius = sqrt(radius2);
         m_ptr->vertBuffer = pDrawer->AllocVertexBuffer(verts);
         if (!m_ptr->vertBuffer) {
             delete m_ptr;
@@ -300,10 +473,20 @@ void GW2LIB::PrimitiveDiffuse::AddTransform(Matrix4x4 transform)
 
 void GW2LIB::PrimitiveDiffuse::Draw() const
 {
+    if (auto pList = DrawList::GetRecording()) {
+        if (m_ptr) {
+            for (size_t i = 0; i < m_ptr->transforms.size(); i++) {
+                pList->Primitive(m_ptr->vertBuffer, m_ptr->indBuffer, m_ptr->type, m_ptr->transforms[i], m_ptr->radius);
+            }
+        }
+        return;
+    }
+
     const auto pDrawer = GetMain()->GetDrawer(true);
     if (pDrawer && m_ptr) {
+        auto pBatch = GetMain()->GetPrimitiveBatch();
         for (size_t i = 0; i < m_ptr->transforms.size(); i++) {
-            pDrawer->DrawPrimitive(m_ptr->vertBuffer, m_ptr->indBuffer, m_ptr->type, m_ptr->transforms[i]);
+            pBatch->Add(m_ptr->vertBuffer, m_ptr->indBuffer, m_ptr->type, m_ptr->transforms[i], m_ptr->radius);
         }
     }
 }
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include "Frustum.h"
+
+#include <xmmintrin.h>
+
+
+void Frustum::Build(const D3DXMATRIX &m)
+{
+    // planes from the columns of the matrix, clip space z is in [0, w] for d3d
+    D3DXPLANE planes[PLANE_COUNT] = {
+        D3DXPLANE(m._14 + m._11, m._24 + m._21, m._34 + m._31, m._44 + m._41),
+        D3DXPLANE(m._14 - m._11, m._24 - m._21, m._34 - m._31, m._44 - m._41),
+        D3DXPLANE(m._14 + m._12, m._24 + m._22, m._34 + m._32, m._44 + m._42),
+        D3DXPLANE(m._14 - m._12, m._24 - m._22, m._34 - m._32, m._44 - m._42),
+        D3DXPLANE(m._13, m._23, m._33, m._43),
+        D3DXPLANE(m._14 - m._13, m._24 - m._23, m._34 - m._33, m._44 - m._43)
+    };
+
+    for (int i = 0; i < 8; i++)
+    {
+        if (i < PLANE_COUNT) {
+            D3DXPLANE p;
+            D3DXPlaneNormalize(&p, &planes[i]);
+            m_nx[i] = p.a;
+            m_ny[i] = p.b;
+            m_nz[i] = p.c;
+            m_d[i] = p.d;
+        } else {
+            m_nx[i] = 0;
+            m_ny[i] = 0;
+            m_nz[i] = 0;
+            m_d[i] = 1e30f;
+        }
+    }
+}
+
+bool Frustum::IsSphereVisible(const D3DXVECTOR3 &center, float radius) const
+{
+    __m128 cx = _mm_set1_ps(center.x);
+    __m128 cy = _mm_set1_ps(center.y);
+    __m128 cz = _mm_set1_ps(center.z);
+    __m128 negR = _mm_set1_ps(-radius);
+
+    for (int i = 0; i < 8; i += 4)
+    {
+        __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(m_nx + i), cx), _mm_mul_ps(_mm_load_ps(m_ny + i), cy)),
+            _mm_add_ps(_mm_mul_ps(_mm_load_ps(m_nz + i), cz), _mm_load_ps(m_d + i)));
+        if (_mm_movemask_ps(_mm_cmplt_ps(dist, negR)))
+            return false;
+    }
+    return true;
+}
+
+void Frustum::CullSpheres(const float *x, const float *y, const float *z, const float *r, size_t count, uint8_t *visible) const
+{
+    for (size_t i = 0; i < count; i += 4)
+    {
+        __m128 cx = _mm_loadu_ps(x + i);
+        __m128 cy = _mm_loadu_ps(y + i);
+        __m128 cz = _mm_loadu_ps(z + i);
+        __m128 negR = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(r + i));
+
+        // 4 spheres against one plane at a time
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < PLANE_COUNT; p++)
+        {
+            __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m_nx[p]), cx), _mm_mul_ps(_mm_set1_ps(m_ny[p]), cy)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m_nz[p]), cz), _mm_set1_ps(m_d[p])));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, negR));
+        }
+
+        int mask = _mm_movemask_ps(outside);
+        for (size_t k = 0; k < 4 && i + k < count; k++)
+            visible[i + k] = (mask >> k) & 1 ? 0 : 1;
+    }
+}
+
+float Frustum::Distance(int plane, const D3DXVECTOR3 &pos) const
+{
+    return m_nx[plane]*pos.x + m_ny[plane]*pos.y + m_nz[plane]*pos.z + m_d[plane];
+}
+
+bool Frustum::ClipLine(D3DXVECTOR3 &pos1, D3DXVECTOR3 &pos2, bool &bClipped) const
+{
+    bClipped = false;
+
+    for (int p = 0; p < PLANE_COUNT; p++) {
+        if (Distance(p, pos1) < 0 && Distance(p, pos2) < 0)
+            return false;
+    }
+
+    // an end point behind the camera would be projected mirrored, so cut the line at the near
+    // plane. the other planes are left to the rasterizer
+    float d1 = Distance(PLANE_NEAR, pos1);
+    float d2 = Distance(PLANE_NEAR, pos2);
+    if (d1 < 0) {
+        pos1 = pos1 + (pos2 - pos1) * (d1 / (d1 - d2));
+        bClipped = true;
+    } else if (d2 < 0) {
+        pos2 = pos2 + (pos1 - pos2) * (d2 / (d2 - d1));
+        bClipped = true;
+    }
+    return true;
+}
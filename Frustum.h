@@ -0,0 +1,37 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "d3dx9.h"
+#include <cstdint>
+
+
+// view frustum planes for culling on the cpu, built from the matrices the drawer projects with.
+// planes point inwards and are kept as structure of arrays, padded to 8 with planes that
+// nothing is outside of, so they can be tested 4 at a time
+class Frustum
+{
+public:
+    // viewProj as in D3DX, row vectors times matrix
+    void Build(const D3DXMATRIX &viewProj);
+
+    bool IsSphereVisible(const D3DXVECTOR3 &center, float radius) const;
+    // sets visible[i] to 0 or 1 for count spheres given as arrays. the arrays must be padded
+    // to a multiple of 4 elements
+    void CullSpheres(const float *x, const float *y, const float *z, const float *r, size_t count, uint8_t *visible) const;
+
+    // false if the line is completely outside, otherwise clips it at the near plane. bClipped
+    // is set if an end point was moved
+    bool ClipLine(D3DXVECTOR3 &pos1, D3DXVECTOR3 &pos2, bool &bClipped) const;
+
+private:
+    enum { PLANE_LEFT, PLANE_RIGHT, PLANE_BOTTOM, PLANE_TOP, PLANE_NEAR, PLANE_FAR, PLANE_COUNT };
+
+    float Distance(int plane, const D3DXVECTOR3 &pos) const;
+
+    alignas(16) float m_nx[8];
+    alignas(16) float m_ny[8];
+    alignas(16) float m_nz[8];
+    alignas(16) float m_d[8];
+};
+
+#endif
@@ -4,10 +4,212 @@
 
 GameData::CharacterData *GameData::GetCharData(hl::ForeignClass pChar)
 {
-    for (const auto& ch : GetMain()->GetGameData()->objData.charDataList) {
-        if (ch && pChar == ch->pCharacter) {
-            return ch.get();
+    return GetMain()->GetGameData()->objData.FindCharacter(pChar);
+}
+
+
+GameData::AgentData *GameData::GameData::ObjectData::FindAgent(void *pAgent) const
+{
+    if (!pAgent)
+        return nullptr;
+    auto it = agentSlotByPointer.find(pAgent);
+    if (it == agentSlotByPointer.end() || it->second >= agentDataList.size())
+        return nullptr;
+    return agentDataList[it->second].get();
+}
+
+GameData::CharacterData *GameData::GameData::ObjectData::FindCharacter(void *pCharacter) const
+{
+    if (!pCharacter)
+        return nullptr;
+    auto it = charIndexByPointer.find(pCharacter);
+    if (it == charIndexByPointer.end() || it->second >= charDataList.size())
+        return nullptr;
+    return charDataList[it->second].get();
+}
+
+GameData::PlayerData *GameData::GameData::ObjectData::FindPlayer(void *pPlayer) const
+{
+    if (!pPlayer)
+        return nullptr;
+    auto it = playerIndexByPointer.find(pPlayer);
+    if (it == playerIndexByPointer.end() || it->second >= playerDataList.size())
+        return nullptr;
+    return playerDataList[it->second].get();
+}
+
+GameData::PlayerData *GameData::GameData::ObjectData::FindPlayerByName(NameId nameId) const
+{
+    if (nameId == NAME_NONE)
+        return nullptr;
+    auto it = playerIndexByName.find(nameId);
+    if (it == playerIndexByName.end() || it->second >= playerDataList.size())
+        return nullptr;
+    return playerDataList[it->second].get();
+}
+
+void GameData::BuildCharacterColumns(const GameData::ObjectData &objData, CharacterColumns &columns)
+{
+    using namespace GW2LIB;
+
+    const auto& chars = objData.charDataList;
+    columns.count = chars.size();
+    columns.words = (columns.count + 31) / 32;
+    size_t padded = columns.words * 32;
+
+    for (auto& flag : columns.flags) {
+        flag.assign(columns.words, 0);
+    }
+    columns.level.assign(padded, 0);
+    columns.profession.assign(padded, 0);
+    columns.posX.assign(padded, 0);
+    columns.posY.assign(padded, 0);
+    columns.posZ.assign(padded, 0);
+
+    for (size_t i = 0; i < columns.count; i++)
+    {
+        const CharacterData *ch = chars[i].get();
+        if (!ch)
+            continue;
+
+        size_t word = i / 32;
+        uint32_t bit = 1u << (i % 32);
+        auto setFlag = [&](CharacterFlag flag, bool value) {
+            if (value) columns.flags[flag][word] |= bit;
+        };
+
+        setFlag(CHAR_FLAG_ALIVE, ch->isAlive);
+        setFlag(CHAR_FLAG_DOWNED, ch->isDowned);
+        setFlag(CHAR_FLAG_CONTROLLED, ch->isControlled);
+        setFlag(CHAR_FLAG_PLAYER, ch->isPlayer);
+        setFlag(CHAR_FLAG_IN_WATER, ch->isInWater);
+        setFlag(CHAR_FLAG_MONSTER, ch->isMonster);
+        setFlag(CHAR_FLAG_MONSTER_PLAYER_CLONE, ch->isMonsterPlayerClone);
+        setFlag(CHAR_FLAG_FRIENDLY, ch->attitude == GW2::ATTITUDE_FRIENDLY);
+        setFlag(CHAR_FLAG_HOSTILE, ch->attitude == GW2::ATTITUDE_HOSTILE);
+        setFlag(CHAR_FLAG_INDIFFERENT, ch->attitude == GW2::ATTITUDE_INDIFFERENT);
+        setFlag(CHAR_FLAG_NEUTRAL, ch->attitude == GW2::ATTITUDE_NEUTRAL);
+        setFlag(CHAR_FLAG_HAS_AGENT, ch->pAgentData != nullptr);
+
+        columns.level[i] = ch->level;
+        columns.profession[i] = ch->profession;
+        if (ch->pAgentData) {
+            columns.posX[i] = ch->pAgentData->pos.x;
+            columns.posY[i] = ch->pAgentData->pos.y;
+            columns.posZ[i] = ch->pAgentData->pos.z;
         }
     }
-    return NULL;
-}
\ No newline at end of file
+}
+
+
+uint64_t GameData::StaticAgentGrid::CellKey(int x, int y)
+{
+    return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+}
+
+int GameData::StaticAgentGrid::CellCoord(float v)
+{
+    return static_cast<int>(floor(v / CELL_SIZE));
+}
+
+void GameData::StaticAgentGrid::Clear()
+{
+    cells.clear();
+    entryCount = 0;
+}
+
+void GameData::StaticAgentGrid::Insert(size_t slot, void *pAgent, D3DXVECTOR3 pos)
+{
+    cells[CellKey(CellCoord(pos.x), CellCoord(pos.y))].push_back({ slot, pAgent, pos });
+    entryCount++;
+}
+
+void GameData::StaticAgentGrid::Query(D3DXVECTOR3 pos, float range, const std::vector<std::unique_ptr<AgentData>> &agents, std::vector<AgentData*> &out) const
+{
+    float range2 = range*range;
+    int x0 = CellCoord(pos.x - range), x1 = CellCoord(pos.x + range);
+    int y0 = CellCoord(pos.y - range), y1 = CellCoord(pos.y + range);
+
+    for (int x = x0; x <= x1; x++) {
+        for (int y = y0; y <= y1; y++)
+        {
+            auto it = cells.find(CellKey(x, y));
+            if (it == cells.end())
+                continue;
+
+            for (const auto& entry : it->second)
+            {
+                if (entry.slot >= agents.size())
+                    continue;
+                AgentData *pAgentData = agents[entry.slot].get();
+                if (!pAgentData || pAgentData->pAgent != entry.pAgent || !pAgentData->isStatic || pAgentData->pos != entry.pos)
+                    continue;
+
+                D3DXVECTOR3 diff = entry.pos - pos;
+                if (D3DXVec3LengthSq(&diff) <= range2)
+                    out.push_back(pAgentData);
+            }
+        }
+    }
+}
+
+template <typename T>
+static void CopyList(const std::vector<std::unique_ptr<T>> &src, std::vector<std::unique_ptr<T>> &dst)
+{
+    dst.resize(src.size());
+    for (size_t i = 0; i < src.size(); i++)
+    {
+        if (!src[i]) {
+            dst[i] = nullptr;
+            continue;
+        }
+        if (!dst[i])
+            dst[i] = std::make_unique<T>();
+        *dst[i] = *src[i];
+    }
+}
+
+void GameData::CopyGameData(const GameData &src, GameData &dst)
+{
+    const auto& srcObj = src.objData;
+    auto& dstObj = dst.objData;
+
+    CopyList(srcObj.agentDataList, dstObj.agentDataList);
+    CopyList(srcObj.charDataList, dstObj.charDataList);
+    CopyList(srcObj.playerDataList, dstObj.playerDataList);
+    dstObj.agentSlotByPointer = srcObj.agentSlotByPointer;
+    dstObj.charIndexByPointer = srcObj.charIndexByPointer;
+    dstObj.playerIndexByPointer = srcObj.playerIndexByPointer;
+    dstObj.playerIndexByName = srcObj.playerIndexByName;
+
+    // links still point into src, look up the same game objects in dst
+    for (auto& pAgentData : dstObj.agentDataList) {
+        if (pAgentData && pAgentData->pCharData)
+            pAgentData->pCharData = dstObj.FindCharacter(pAgentData->pCharData->pCharacter);
+    }
+    for (auto& pCharData : dstObj.charDataList) {
+        if (pCharData->pAgentData)
+            pCharData->pAgentData = dstObj.FindAgent(pCharData->pAgentData->pAgent);
+        if (pCharData->pPlayerData)
+            pCharData->pPlayerData = dstObj.FindPlayer(pCharData->pPlayerData->pPlayer);
+    }
+    for (auto& pPlayerData : dstObj.playerDataList) {
+        if (pPlayerData->pCharData)
+            pPlayerData->pCharData = dstObj.FindCharacter(pPlayerData->pCharData->pCharacter);
+    }
+
+    dstObj.ownCharacter = srcObj.ownCharacter ? dstObj.FindCharacter(srcObj.ownCharacter->pCharacter) : nullptr;
+    dstObj.ownAgent = srcObj.ownAgent ? dstObj.FindAgent(srcObj.ownAgent->pAgent) : nullptr;
+    dstObj.autoSelection = srcObj.autoSelection ? dstObj.FindAgent(srcObj.autoSelection->pAgent) : nullptr;
+    dstObj.hoverSelection = srcObj.hoverSelection ? dstObj.FindAgent(srcObj.hoverSelection->pAgent) : nullptr;
+    dstObj.lockedSelection = srcObj.lockedSelection ? dstObj.FindAgent(srcObj.lockedSelection->pAgent) : nullptr;
+
+    dst.charColumns = src.charColumns;
+    dst.staticAgents = src.staticAgents;
+    dst.camData = src.camData;
+    dst.refreshStats = src.refreshStats;
+    dst.mouseInWorld = src.mouseInWorld;
+    dst.mapId = src.mapId;
+    dst.ping = src.ping;
+    dst.fps = src.fps;
+}
@@ -3,17 +3,22 @@
 
 #include "gw2lib.h"
 
+#include "NameTable.h"
+
 #include "hacklib/ForeignClass.h"
 
 #include "d3dx9.h"
 #include <string>
 #include <vector>
 #include <memory>
+#include <unordered_map>
+#include <atomic>
 
 
 namespace GameData
 {
     struct CharacterData;
+    struct PlayerData;
 
     struct AgentData
     {
@@ -24,12 +29,34 @@ namespace GameData
         int agentId = 0;
         D3DXVECTOR3 pos = D3DXVECTOR3(0, 0, 0);
         float rot = 0;
+        // ticks since the last refresh, counted from the capture tick so dropped frames are included
+        int staleTicks = 0;
+        uint64_t lastRefreshTick = 0;
+        // false until the agent was refreshed once
+        bool hasData = false;
+        // agent does not move and is only refreshed on a long interval
+        bool isStatic = false;
+        bool inStaticGrid = false;
+        D3DXVECTOR3 staticGridPos = D3DXVECTOR3(0, 0, 0);
+
+        // filled by the derived jobs after every decode, see DerivedData.h
+        float distToSelf = 0;
+        float threat = 0;
+        D3DXVECTOR2 screenPos = D3DXVECTOR2(0, 0);
+        bool onScreen = false;
+        int clusterId = -1;
+        GW2LIB::EspLod espLod = GW2LIB::ESP_LOD_FULL;
     };
 
     struct CharacterData
     {
         hl::ForeignClass pCharacter = nullptr;
         AgentData *pAgentData = nullptr;
+        int agentId = 0;
+        int staleTicks = 0;
+        uint64_t lastRefreshTick = 0;
+        // false until the character was refreshed once
+        bool hasData = false;
         bool isAlive = false;
         bool isDowned = false;
         bool isControlled = false;
@@ -49,7 +76,57 @@ namespace GameData
         GW2LIB::GW2::BreakbarState breakbarState = GW2LIB::GW2::BREAKBAR_STATE_NONE;
         GW2LIB::GW2::Profession profession = GW2LIB::GW2::Profession::PROFESSION_NONE;
         GW2LIB::GW2::Attitude attitude = GW2LIB::GW2::Attitude::ATTITUDE_FRIENDLY;
-        std::string name;
+        void *pPlayer = nullptr;
+        PlayerData *pPlayerData = nullptr;
+    };
+
+    struct PlayerData
+    {
+        void *pPlayer = nullptr;
+        CharacterData *pCharData = nullptr;
+        bool hasName = false;
+        NameId nameId = NAME_NONE;
+        // points into the name table, valid for the lifetime of the library
+        std::string_view name;
+    };
+
+    // column view of charDataList rebuilt every tick, index i refers to charDataList[i]
+    // bitsets hold bit (i % 32) of word (i / 32), numeric columns are padded to whole words
+    struct CharacterColumns
+    {
+        size_t count = 0;
+        size_t words = 0;
+        std::vector<uint32_t> flags[GW2LIB::CHAR_FLAG_COUNT];
+        std::vector<int> level;
+        std::vector<int> profession;
+        std::vector<float> posX;
+        std::vector<float> posY;
+        std::vector<float> posZ;
+    };
+
+    // positions of static agents bucketed into a grid on the xy-plane. entries are not removed
+    // when agents despawn, they are validated against agentDataList on lookup instead.
+    // the grid survives across ticks until the map changes
+    struct StaticAgentGrid
+    {
+        struct Entry
+        {
+            size_t slot;
+            void *pAgent;
+            D3DXVECTOR3 pos;
+        };
+
+        static const int CELL_SIZE = 1000;
+
+        int mapId = 0;
+        size_t entryCount = 0;
+        std::unordered_map<uint64_t, std::vector<Entry>> cells;
+
+        void Clear();
+        void Insert(size_t slot, void *pAgent, D3DXVECTOR3 pos);
+        void Query(D3DXVECTOR3 pos, float range, const std::vector<std::unique_ptr<AgentData>> &agents, std::vector<AgentData*> &out) const;
+        static uint64_t CellKey(int x, int y);
+        static int CellCoord(float v);
     };
 
     struct GameData
@@ -58,13 +135,29 @@ namespace GameData
         {
             std::vector<std::unique_ptr<CharacterData>> charDataList;
             std::vector<std::unique_ptr<AgentData>> agentDataList;
+            std::vector<std::unique_ptr<PlayerData>> playerDataList;
             CharacterData *ownCharacter = nullptr;
             AgentData *ownAgent = nullptr;
             AgentData *autoSelection = nullptr;
             AgentData *hoverSelection = nullptr;
             AgentData *lockedSelection = nullptr;
+
+            // game object pointer to index in agentDataList or charDataList, rebuilt every tick
+            std::unordered_map<void*, size_t> agentSlotByPointer;
+            std::unordered_map<void*, size_t> charIndexByPointer;
+            std::unordered_map<void*, size_t> playerIndexByPointer;
+            // interned name to index in playerDataList, rebuilt every tick
+            std::unordered_map<NameId, size_t> playerIndexByName;
+
+            AgentData *FindAgent(void *pAgent) const;
+            CharacterData *FindCharacter(void *pCharacter) const;
+            PlayerData *FindPlayer(void *pPlayer) const;
+            PlayerData *FindPlayerByName(NameId nameId) const;
         } objData;
 
+        CharacterColumns charColumns;
+        StaticAgentGrid staticAgents;
+
         struct CamData
         {
             bool valid = false;
@@ -73,13 +166,26 @@ namespace GameData
             float fovy = 0;
         } camData;
 
+        GW2LIB::RefreshStats refreshStats = {};
+
         D3DXVECTOR3 mouseInWorld = D3DXVECTOR3(0, 0, 0);
         int mapId = 0;
         int ping = 0;
         int fps = 0;
     };
 
+    // copy of GameData handed out to reader threads. snapshots are reused once readers is 0
+    struct Snapshot
+    {
+        GameData data;
+        uint64_t tick = 0;
+        std::atomic<int> readers{0};
+    };
+
     CharacterData *GetCharData(hl::ForeignClass pChar);
+    // deep copy that keeps the allocations of dst and points all links into dst
+    void CopyGameData(const GameData &src, GameData &dst);
+    void BuildCharacterColumns(const GameData::ObjectData &objData, CharacterColumns &columns);
 }
 
 #endif
\ No newline at end of file
@@ -82,3 +82,197 @@ int GW2LIB::GetPing() {
 int GW2LIB::GetFPS() {
     return GetMain()->GetGameData()->fps;
 }
+
+
+void GW2LIB::SetRefreshBudget(int maxEntities, float maxMicroseconds, float priorityRange)
+{
+    GameData::RefreshBudget budget;
+    budget.maxEntities = maxEntities;
+    budget.maxMicroseconds = maxMicroseconds;
+    budget.priorityRange = priorityRange;
+    GetMain()->SetRefreshBudget(budget);
+}
+
+void GW2LIB::SetMems(const Mems& mems)
+{
+    GetMain()->SetMems(&mems);
+}
+
+void GW2LIB::ResetMems()
+{
+    GetMain()->SetMems(nullptr);
+}
+
+bool GW2LIB::EnableSnapshotExport(const char *name)
+{
+    return GetMain()->SetSnapshotExport(name ? name : SharedSnapshot::DEFAULT_NAME);
+}
+
+void GW2LIB::DisableSnapshotExport()
+{
+    GetMain()->SetSnapshotExport(nullptr);
+}
+
+GW2LIB::Snapshot::Snapshot(GameData::Snapshot *pSnapshot, GameData::Snapshot *pPrevious)
+    : m_ptr(pSnapshot), m_pPrevious(pPrevious)
+{
+}
+
+GW2LIB::Snapshot::~Snapshot()
+{
+    if (m_ptr)
+        GetMain()->ReleaseSnapshot(m_ptr, m_pPrevious);
+}
+
+uint64_t GW2LIB::Snapshot::GetTick() const
+{
+    return m_ptr ? m_ptr->tick : 0;
+}
+
+GW2LIB::Snapshot GW2LIB::AcquireSnapshot()
+{
+    GameData::Snapshot *pPrevious = GetMain()->GetThreadSnapshot();
+    return Snapshot(GetMain()->AcquireSnapshot(), pPrevious);
+}
+
+bool GW2LIB::WaitForNextTick(int timeoutMs)
+{
+    auto& signal = GetMain()->m_tickSignal;
+    return signal.WaitPast(signal.Get(), timeoutMs);
+}
+
+bool GW2LIB::WaitForFrame(int timeoutMs)
+{
+    auto& signal = GetMain()->m_frameSignal;
+    return signal.WaitPast(signal.Get(), timeoutMs);
+}
+
+uint64_t GW2LIB::GetTickSequence()
+{
+    return GetMain()->m_tickSignal.Get();
+}
+
+void GW2LIB::Task::promise_type::unhandled_exception()
+{
+    ASYNC_LOG_ERR("[Task] Unhandled exception, task ended\n");
+}
+
+void GW2LIB::StartTask(Task task)
+{
+    GetMain()->GetTaskScheduler()->Add(task.m_handle);
+    task.m_handle = nullptr;
+}
+
+void GW2LIB::SetTaskFrameBudget(float microseconds)
+{
+    GetMain()->GetTaskScheduler()->SetFrameBudget(microseconds);
+}
+
+bool GW2LIB::IsTaskSliceExpired(float microseconds)
+{
+    return GetMain()->GetTaskScheduler()->IsSliceExpired(microseconds);
+}
+
+GW2LIB::RefreshStats GW2LIB::GetRefreshStats()
+{
+    return GetMain()->GetGameData()->refreshStats;
+}
+
+std::vector<GW2LIB::Agent> GW2LIB::GetStaticAgentsInRange(Vector3 pos, float range)
+{
+    const auto pGameData = GetMain()->GetGameData();
+
+    std::vector<GameData::AgentData*> found;
+    pGameData->staticAgents.Query(D3DXVECTOR3(pos.x, pos.y, pos.z), range, pGameData->objData.agentDataList, found);
+
+    std::vector<Agent> agents;
+    for (auto pAgentData : found) {
+        Agent ag;
+        ag.m_ptr = pAgentData;
+        agents.push_back(ag);
+    }
+    return agents;
+}
+
+void GW2LIB::RegisterDerivedJob(const char *name, void (*run)(size_t begin, size_t end), void (*finish)())
+{
+    GetMain()->GetDerivedJobs()->RegisterUser({ name, run, finish });
+}
+
+size_t GW2LIB::GetAgentSlotCount()
+{
+    return GetMain()->GetGameData()->objData.agentDataList.size();
+}
+
+GW2LIB::Agent GW2LIB::GetAgentBySlot(size_t slot)
+{
+    const auto& agents = GetMain()->GetGameData()->objData.agentDataList;
+
+    Agent agent;
+    if (slot < agents.size()) {
+        agent.m_ptr = agents[slot].get();
+        agent.iterator = slot;
+    }
+    return agent;
+}
+
+GW2LIB::Agent GW2LIB::FindAgentByGamePointer(void *pAgent)
+{
+    Agent agent;
+    agent.m_ptr = GetMain()->GetGameData()->objData.FindAgent(pAgent);
+    return agent;
+}
+
+GW2LIB::Character GW2LIB::FindCharacterByGamePointer(void *pCharacter)
+{
+    Character chr;
+    chr.m_ptr = GetMain()->GetGameData()->objData.FindCharacter(pCharacter);
+    return chr;
+}
+
+GW2LIB::Character GW2LIB::FindCharacterByName(std::string_view name, bool ignoreCase)
+{
+    const auto pGameData = GetMain()->GetGameData();
+    const auto pNames = GetMain()->GetNameTable();
+
+    Character chr;
+    if (!ignoreCase) {
+        auto pPlayerData = pGameData->objData.FindPlayerByName(pNames->Find(name));
+        if (pPlayerData)
+            chr.m_ptr = pPlayerData->pCharData;
+        return chr;
+    }
+
+    // case folding keeps the byte length, so a whole-name match is a prefix match of equal size
+    std::vector<GameData::NameId> ids;
+    pNames->FindPrefix(name, true, ids);
+    for (auto id : ids) {
+        if (pNames->Get(id).size() != name.size())
+            continue;
+        auto pPlayerData = pGameData->objData.FindPlayerByName(id);
+        if (pPlayerData && pPlayerData->pCharData) {
+            chr.m_ptr = pPlayerData->pCharData;
+            break;
+        }
+    }
+    return chr;
+}
+
+std::vector<GW2LIB::Character> GW2LIB::FindCharactersByNamePrefix(std::string_view prefix, bool ignoreCase)
+{
+    const auto pGameData = GetMain()->GetGameData();
+
+    std::vector<GameData::NameId> ids;
+    GetMain()->GetNameTable()->FindPrefix(prefix, ignoreCase, ids);
+
+    std::vector<Character> chars;
+    for (auto id : ids) {
+        auto pPlayerData = pGameData->objData.FindPlayerByName(id);
+        if (pPlayerData && pPlayerData->pCharData) {
+            Character chr;
+            chr.m_ptr = pPlayerData->pCharData;
+            chars.push_back(chr);
+        }
+    }
+    return chars;
+}
\ No newline at end of file
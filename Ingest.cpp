@@ -0,0 +1,559 @@
+#include "main.h"
+
+#include "hacklib/Logging.h"
+
+#include <algorithm>
+
+
+// characters or agents per job of the worker pool
+static const size_t DECODE_GRAIN = 64;
+
+
+void Gw2HackMain::StartIngest()
+{
+    for (auto& frame : m_captureFrames) {
+        frame = std::make_unique<GameData::CaptureFrame>();
+    }
+    m_pCaptureWrite = m_captureFrames[0].get();
+    m_pCapturePending = m_captureFrames[1].get();
+    m_pCaptureDecode = m_captureFrames[2].get();
+    m_bCapturePending = false;
+    m_bIngestStop = false;
+
+    // leave cores for the game and render threads. the ingest thread itself also works on jobs
+    size_t nCores = std::thread::hardware_concurrency();
+    m_jobPool.Start(nCores > 3 ? nCores - 3 : 0);
+
+    m_ingestThread = std::thread(&Gw2HackMain::IngestLoop, this);
+}
+
+void Gw2HackMain::StopIngest()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_captureMutex);
+        m_bIngestStop = true;
+    }
+    m_cvCapture.notify_one();
+
+    if (m_ingestThread.joinable())
+        m_ingestThread.join();
+
+    m_jobPool.Stop();
+}
+
+
+void Gw2HackMain::IngestLoop()
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_captureMutex);
+            m_cvCapture.wait(lock, [this]{ return m_bIngestStop || m_bCapturePending; });
+            if (m_bIngestStop)
+                return;
+
+            std::swap(m_pCaptureDecode, m_pCapturePending);
+            m_bCapturePending = false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_gameDataMutex);
+
+            [&]{
+                __try {
+                    DecodeCapture(*m_pCaptureDecode);
+                } __except (EXCEPTION_EXECUTE_HANDLER) {
+                    ASYNC_LOG_ERR("[IngestLoop] Exception in decode\n");
+                }
+            }();
+        }
+
+        // the data of the tick is visible now, wake up WaitForNextTick
+        m_tickSignal.Signal();
+
+        // walking the memory map takes a while, the game thread gets the result on its next publish
+        if (m_pCaptureDecode->tick >= m_pageCacheRebuildTick)
+        {
+            m_pageCacheRebuildTick = m_pCaptureDecode->tick + GameData::PAGE_CACHE_REBUILD_TICKS;
+
+            GameData::PageCache pageCache;
+            pageCache.Rebuild();
+
+            std::lock_guard<std::mutex> lock(m_captureMutex);
+            std::swap(m_pageCacheNext, pageCache);
+            m_bPageCacheNew = true;
+        }
+    }
+}
+
+
+template <typename Layout>
+void Gw2HackMain::DecodeAgent(const Layout &layout, GameData::AgentData *pAgentData, const GameData::AgentCapture &capture, const uint8_t *pRaw)
+{
+    pAgentData->pAgent = capture.pAgent;
+    pAgentData->category = capture.category;
+    pAgentData->type = capture.type;
+    pAgentData->agentId = capture.agentId;
+    pAgentData->pos = capture.pos;
+
+    if (capture.hasTransform)
+    {
+        const auto& plan = layout.agentPlan;
+        pAgentData->rot = atan2(plan.transform.decode<float>(pRaw, layout.mems.agtransRY), plan.transform.decode<float>(pRaw, layout.mems.agtransRX));
+    }
+}
+
+template <typename Layout>
+void Gw2HackMain::DecodeCharacter(const Layout &layout, GameData::CharacterData *pCharData, const GameData::CharacterCapture &capture, const uint8_t *pRaw)
+{
+    typedef GameData::CharacterCapture CC;
+    const auto& plan = layout.charPlan;
+
+    pCharData->pCharacter = capture.pCharacter;
+    pCharData->agentId = capture.agentId;
+
+    pCharData->isAlive = capture.isAlive;
+    pCharData->isDowned = capture.isDowned;
+    pCharData->isControlled = capture.isControlled;
+    pCharData->isPlayer = capture.isPlayer;
+    pCharData->isInWater = capture.isInWater;
+    pCharData->isMonster = capture.isMonster;
+    pCharData->isMonsterPlayerClone = capture.isMonsterPlayerClone;
+
+    if (capture.spans & CC::SPAN_CHARACTER) {
+        pCharData->attitude = plan.character.decode<GW2LIB::GW2::Attitude>(pRaw, layout.mems.charAttitude);
+        pCharData->gliderPercent = plan.character.decode<float>(pRaw, layout.mems.charGliderPercent);
+    }
+
+    if (capture.spans & CC::SPAN_HEALTH) {
+        pCharData->currentHealth = plan.health.decode<float>(pRaw, layout.mems.healthCurrent);
+        pCharData->maxHealth = plan.health.decode<float>(pRaw, layout.mems.healthMax);
+    }
+
+    if (capture.spans & CC::SPAN_ENDURANCE) {
+        pCharData->currentEndurance = static_cast<float>(plan.endurance.decode<int>(pRaw, layout.mems.endCurrent));
+        pCharData->maxEndurance = static_cast<float>(plan.endurance.decode<int>(pRaw, layout.mems.endMax));
+    }
+
+    if (capture.spans & CC::SPAN_CORESTATS) {
+        pCharData->profession = plan.coreStats.decode<GW2LIB::GW2::Profession>(pRaw, layout.mems.statsProfession);
+        pCharData->level = plan.coreStats.decode<int>(pRaw, layout.mems.statsLevel);
+        pCharData->scaledLevel = plan.coreStats.decode<int>(pRaw, layout.mems.statsScaledLevel);
+    }
+
+    if (capture.spans & CC::SPAN_INVENTORY) {
+        pCharData->wvwsupply = plan.inventory.decode<int>(pRaw, layout.mems.invSupply);
+    }
+
+    if (capture.spans & CC::SPAN_BREAKBAR) {
+        pCharData->breakbarState = plan.breakbar.decode<GW2LIB::GW2::BreakbarState>(pRaw, layout.mems.breakbarState);
+        pCharData->breakbarPercent = plan.breakbar.decode<float>(pRaw, layout.mems.breakbarPercent);
+    }
+
+    pCharData->pPlayer = capture.pPlayer;
+}
+
+
+void Gw2HackMain::DecodePlayers(const GameData::CaptureFrame &frame)
+{
+    auto& objData = m_gameData.objData;
+
+    // players keep their PlayerData and decoded name while the player object lives
+    size_t sizePlayerArray = frame.players.size();
+    m_playerDataScratch.clear();
+    m_playerDataScratch.resize(sizePlayerArray);
+
+    for (size_t i = 0; i < sizePlayerArray; i++)
+    {
+        const auto& capture = frame.players[i];
+
+        auto it = objData.playerIndexByPointer.find(capture.pPlayer);
+        if (it != objData.playerIndexByPointer.end()) {
+            m_playerDataScratch[i] = std::move(objData.playerDataList[it->second]);
+        } else {
+            m_playerDataScratch[i] = std::make_unique<GameData::PlayerData>();
+            m_playerDataScratch[i]->pPlayer = capture.pPlayer;
+        }
+
+        GameData::PlayerData *pPlayerData = m_playerDataScratch[i].get();
+        pPlayerData->pCharData = nullptr;
+
+        if (capture.hasName) {
+            pPlayerData->nameId = m_names.Intern(capture.name, wcslen(capture.name));
+            pPlayerData->name = m_names.Get(pPlayerData->nameId);
+            pPlayerData->hasName = true;
+        }
+    }
+
+    std::swap(objData.playerDataList, m_playerDataScratch);
+    m_playerDataScratch.clear();
+
+    objData.playerIndexByPointer.clear();
+    objData.playerIndexByName.clear();
+    for (size_t i = 0; i < sizePlayerArray; i++) {
+        objData.playerIndexByPointer[frame.players[i].pPlayer] = i;
+        if (objData.playerDataList[i]->hasName)
+            objData.playerIndexByName[objData.playerDataList[i]->nameId] = i;
+    }
+}
+
+void Gw2HackMain::DecodeCapture(const GameData::CaptureFrame &frame)
+{
+    auto& objData = m_gameData.objData;
+
+    m_gameData.camData.valid = frame.camValid;
+    if (frame.camValid) {
+        m_gameData.camData.camPos = frame.camPos;
+        m_gameData.camData.fovy = frame.fovy;
+        D3DXVec3Normalize(&m_gameData.camData.viewVec, &(frame.camLookAt-frame.camPos));
+    }
+
+    if (!frame.objectsValid) {
+        objData.charDataList.clear();
+        objData.agentDataList.clear();
+        objData.playerDataList.clear();
+        objData.charIndexByPointer.clear();
+        objData.agentSlotByPointer.clear();
+        objData.playerIndexByPointer.clear();
+        objData.playerIndexByName.clear();
+    } else {
+        // agents keep their AgentData while the slot holds the same game object
+        size_t sizeAgentArray = frame.agents.size();
+        if (sizeAgentArray != objData.agentDataList.size()) {
+            objData.agentDataList.resize(sizeAgentArray);
+        }
+
+        m_jobPool.ParallelFor(sizeAgentArray, DECODE_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                const auto& capture = frame.agents[i];
+                auto& pAgentData = objData.agentDataList[i];
+
+                if (!capture.pAgent) {
+                    pAgentData = nullptr;
+                    continue;
+                }
+
+                if (!pAgentData || pAgentData->pAgent != capture.pAgent) {
+                    pAgentData = std::make_unique<GameData::AgentData>();
+                    pAgentData->pAgent = capture.pAgent;
+                    pAgentData->lastRefreshTick = frame.tick;
+                }
+
+                if (capture.refreshed) {
+                    if (frame.pLayout)
+                        DecodeAgent(*frame.pLayout, pAgentData.get(), capture, frame.AgentRaw(i));
+                    else
+                        DecodeAgent(m_staticLayout, pAgentData.get(), capture, frame.AgentRaw(i));
+                    pAgentData->lastRefreshTick = frame.tick;
+                    pAgentData->hasData = true;
+                }
+                // static agents are refreshed on their own interval and are not counted as stale
+                pAgentData->staleTicks = capture.isStatic ? 0 : static_cast<int>(frame.tick - pAgentData->lastRefreshTick);
+                pAgentData->isStatic = capture.isStatic;
+                pAgentData->pCharData = nullptr;
+            }
+        });
+
+        objData.agentSlotByPointer.clear();
+        for (size_t i = 0; i < sizeAgentArray; i++) {
+            if (frame.agents[i].pAgent)
+                objData.agentSlotByPointer[frame.agents[i].pAgent] = i;
+        }
+
+        UpdateStaticAgents(frame.mapId);
+
+        // characters keep their CharacterData while the game object lives, so data that was
+        // skipped by the refresh budget is still around
+        size_t sizeCharArray = frame.chars.size();
+        m_charDataScratch.clear();
+        m_charDataScratch.resize(sizeCharArray);
+        for (size_t i = 0; i < sizeCharArray; i++) {
+            auto it = objData.charIndexByPointer.find(frame.chars[i].pCharacter);
+            if (it != objData.charIndexByPointer.end()) {
+                m_charDataScratch[i] = std::move(objData.charDataList[it->second]);
+            } else {
+                m_charDataScratch[i] = std::make_unique<GameData::CharacterData>();
+                m_charDataScratch[i]->lastRefreshTick = frame.tick;
+            }
+        }
+        std::swap(objData.charDataList, m_charDataScratch);
+        m_charDataScratch.clear();
+
+        objData.charIndexByPointer.clear();
+        for (size_t i = 0; i < sizeCharArray; i++) {
+            objData.charIndexByPointer[frame.chars[i].pCharacter] = i;
+        }
+
+        m_jobPool.ParallelFor(sizeCharArray, DECODE_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                GameData::CharacterData *pCharData = objData.charDataList[i].get();
+                if (frame.chars[i].refreshed) {
+                    if (frame.pLayout)
+                        DecodeCharacter(*frame.pLayout, pCharData, frame.chars[i], frame.CharRaw(i));
+                    else
+                        DecodeCharacter(m_staticLayout, pCharData, frame.chars[i], frame.CharRaw(i));
+                    pCharData->lastRefreshTick = frame.tick;
+                    pCharData->hasData = true;
+                }
+                pCharData->staleTicks = static_cast<int>(frame.tick - pCharData->lastRefreshTick);
+                pCharData->pAgentData = nullptr;
+            }
+        });
+
+        DecodePlayers(frame);
+
+        // link agentdata of corresponding agent and the player table
+        for (size_t i = 0; i < sizeCharArray; i++)
+        {
+            GameData::CharacterData *pCharData = objData.charDataList[i].get();
+            size_t agentId = pCharData->agentId;
+
+            // the agent id is only known once the character was refreshed
+            if (pCharData->hasData && agentId < sizeAgentArray && objData.agentDataList[agentId]) {
+                pCharData->pAgentData = objData.agentDataList[agentId].get();
+                pCharData->pAgentData->pCharData = pCharData;
+            }
+
+            pCharData->pPlayerData = objData.FindPlayer(pCharData->pPlayer);
+            if (pCharData->pPlayerData)
+                pCharData->pPlayerData->pCharData = pCharData;
+        }
+    }
+
+    objData.ownCharacter = nullptr;
+    objData.ownAgent = nullptr;
+    objData.autoSelection = nullptr;
+    objData.hoverSelection = nullptr;
+    objData.lockedSelection = nullptr;
+
+    if (frame.objectsValid)
+    {
+        objData.ownCharacter = objData.FindCharacter(frame.pControlledCharacter);
+        if (objData.ownCharacter)
+            objData.ownAgent = objData.ownCharacter->pAgentData;
+
+        objData.autoSelection = objData.FindAgent(frame.pAutoSelection);
+        objData.hoverSelection = objData.FindAgent(frame.pHoverSelection);
+        objData.lockedSelection = objData.FindAgent(frame.pLockedSelection);
+    }
+
+    GameData::BuildCharacterColumns(objData, m_gameData.charColumns);
+    RunDerivedJobs();
+
+    UpdateRefreshPriority(frame);
+    UpdateRefreshStats(frame);
+
+    m_gameData.mouseInWorld = frame.mouseInWorld;
+    m_gameData.mapId = frame.mapId;
+    m_gameData.ping = frame.ping;
+    m_gameData.fps = frame.fps;
+
+    PublishSnapshot(frame.tick);
+
+    std::lock_guard<std::mutex> lock(m_snapshotMutex);
+    m_snapshotExport.Publish(m_gameData, frame.tick);
+}
+
+
+void Gw2HackMain::PublishSnapshot(uint64_t tick)
+{
+    if (!m_bSnapshotsUsed)
+        return;
+
+    // any snapshot that is neither current nor held by a reader can be overwritten. readers
+    // only pin the current one, so one that is not current now can not gain a reader
+    GameData::Snapshot *pCurrent = m_pSnapshot;
+    GameData::Snapshot *pFree = nullptr;
+    for (auto& pSnapshot : m_snapshots) {
+        if (!pSnapshot)
+            pSnapshot = std::make_unique<GameData::Snapshot>();
+        if (pSnapshot.get() != pCurrent && pSnapshot->readers == 0) {
+            pFree = pSnapshot.get();
+            break;
+        }
+    }
+
+    // all snapshots are held, the readers keep their older views and we try again next tick
+    if (!pFree)
+        return;
+
+    GameData::CopyGameData(m_gameData, pFree->data);
+    pFree->tick = tick;
+
+    {
+        std::lock_guard<std::mutex> lock(m_snapshotWaitMutex);
+        m_pSnapshot = pFree;
+    }
+    m_cvSnapshot.notify_all();
+}
+
+
+bool Gw2HackMain::SetSnapshotExport(const char *name)
+{
+    std::lock_guard<std::mutex> lock(m_snapshotMutex);
+    if (!name) {
+        m_snapshotExport.Close();
+        return true;
+    }
+    if (!m_snapshotExport.Open(name)) {
+        HL_LOG_ERR("[SnapshotExport] could not map shared memory %s\n", name);
+        return false;
+    }
+    return true;
+}
+
+
+void Gw2HackMain::UpdateRefreshPriority(const GameData::CaptureFrame &frame)
+{
+    const auto& objData = m_gameData.objData;
+
+    GameData::RefreshPriority prio;
+    prio.decodedTick = frame.tick;
+    auto addAgent = [&](const GameData::AgentData *pAgentData) {
+        if (!pAgentData)
+            return;
+        prio.agents.push_back(pAgentData->pAgent);
+        if (pAgentData->pCharData)
+            prio.chars.push_back(pAgentData->pCharData->pCharacter);
+    };
+
+    if (objData.ownCharacter)
+        prio.chars.push_back(objData.ownCharacter->pCharacter);
+    addAgent(objData.ownAgent);
+    addAgent(objData.autoSelection);
+    addAgent(objData.hoverSelection);
+    addAgent(objData.lockedSelection);
+
+    // objects whose first capture was in a frame that was dropped before decoding
+    for (const auto& ag : objData.agentDataList) {
+        if (ag && !ag->hasData)
+            prio.agents.push_back(ag->pAgent);
+    }
+    for (const auto& ch : objData.charDataList) {
+        if (!ch->hasData)
+            prio.chars.push_back(ch->pCharacter);
+    }
+    for (const auto& pl : objData.playerDataList) {
+        if (!pl->hasName)
+            prio.players.push_back(pl->pPlayer);
+    }
+
+    if (objData.ownAgent)
+    {
+        D3DXVECTOR3 ownPos = objData.ownAgent->pos;
+        float range2 = frame.budget.priorityRange * frame.budget.priorityRange;
+
+        for (const auto& ch : objData.charDataList) {
+            if (ch->attitude != GW2LIB::GW2::ATTITUDE_HOSTILE || !ch->pAgentData)
+                continue;
+            D3DXVECTOR3 diff = ch->pAgentData->pos - ownPos;
+            if (D3DXVec3LengthSq(&diff) <= range2)
+                addAgent(ch->pAgentData);
+        }
+    }
+
+    std::sort(prio.agents.begin(), prio.agents.end());
+    std::sort(prio.chars.begin(), prio.chars.end());
+    std::sort(prio.players.begin(), prio.players.end());
+
+    std::lock_guard<std::mutex> lock(m_captureMutex);
+    m_refreshPriorityNext = std::move(prio);
+    m_bRefreshPriorityNew = true;
+}
+
+void Gw2HackMain::UpdateRefreshStats(const GameData::CaptureFrame &frame)
+{
+    const auto& objData = m_gameData.objData;
+    auto& stats = m_gameData.refreshStats;
+
+    stats.budgetEntities = frame.budget.maxEntities;
+    stats.budgetMicroseconds = frame.budget.maxMicroseconds;
+    stats.entitiesRefreshed = frame.entitiesRefreshed;
+    stats.captureMicroseconds = frame.captureMicroseconds;
+    stats.agentSlotsChanged = frame.agentSlotsChanged;
+    stats.vcallsSaved = frame.vcallsSaved;
+    stats.objectFaults = frame.objectFaults;
+    stats.quarantined = frame.quarantined;
+    for (int i = 0; i < GW2LIB::CAPTURE_FIELD_COUNT; i++)
+        stats.fieldFaults[i] = frame.fieldFaults[i];
+    stats.pageCacheMisses = frame.pageCacheMisses;
+    stats.runtimeMems = frame.pLayout != nullptr;
+    float &avgMicroseconds = frame.pLayout ? stats.avgCaptureMicrosecondsRuntime : stats.avgCaptureMicrosecondsStatic;
+    avgMicroseconds = avgMicroseconds ? 0.95f*avgMicroseconds + 0.05f*frame.captureMicroseconds : frame.captureMicroseconds;
+    stats.entitiesTotal = 0;
+    stats.maxStaleTicks = 0;
+
+    for (const auto& ag : objData.agentDataList) {
+        if (!ag)
+            continue;
+        stats.entitiesTotal++;
+        if (ag->staleTicks > stats.maxStaleTicks)
+            stats.maxStaleTicks = ag->staleTicks;
+    }
+    for (const auto& ch : objData.charDataList) {
+        stats.entitiesTotal++;
+        if (ch->staleTicks > stats.maxStaleTicks)
+            stats.maxStaleTicks = ch->staleTicks;
+    }
+
+    stats.coverage = stats.entitiesTotal ? static_cast<float>(stats.entitiesRefreshed) / stats.entitiesTotal : 1.0f;
+}
+
+
+void Gw2HackMain::RunDerivedJobs()
+{
+    const auto& objData = m_gameData.objData;
+    const auto& camData = m_gameData.camData;
+
+    GameData::DerivedContext ctx;
+    ctx.pOwnAgent = objData.ownAgent;
+    ctx.pOwnCharacter = objData.ownCharacter;
+    ctx.espBudget = m_espDrawCallBudget;
+
+    // same matrices RenderHook builds, with the viewport of the last frame
+    uint32_t width = m_viewportWidth;
+    uint32_t height = m_viewportHeight;
+    if (camData.valid && width && height)
+    {
+        D3DXMATRIX viewMat, projMat;
+        D3DXMatrixLookAtLH(&viewMat, &camData.camPos, &(camData.camPos+camData.viewVec), &D3DXVECTOR3(0, 0, -1));
+        D3DXMatrixPerspectiveFovLH(&projMat, camData.fovy, static_cast<float>(width)/height, 0.01f, 100000.0f);
+        ctx.viewProj = viewMat * projMat;
+        ctx.screenWidth = static_cast<float>(width);
+        ctx.screenHeight = static_cast<float>(height);
+        ctx.hasViewProj = true;
+    }
+
+    m_derivedJobs.Run(m_gameData, m_jobPool, ctx);
+}
+
+
+void Gw2HackMain::UpdateStaticAgents(int mapId)
+{
+    auto& grid = m_gameData.staticAgents;
+    const auto& agents = m_gameData.objData.agentDataList;
+
+    // drop everything on map change and when despawned agents pile up in the grid
+    bool bRebuild = grid.mapId != mapId || grid.entryCount > 2*m_staticAgentCount + 256;
+    if (bRebuild) {
+        grid.Clear();
+        grid.mapId = mapId;
+    }
+
+    m_staticAgentCount = 0;
+    for (size_t i = 0; i < agents.size(); i++)
+    {
+        GameData::AgentData *pAgentData = agents[i].get();
+        if (!pAgentData || !pAgentData->isStatic || !pAgentData->hasData)
+            continue;
+
+        m_staticAgentCount++;
+        if (bRebuild || !pAgentData->inStaticGrid || pAgentData->staticGridPos != pAgentData->pos) {
+            grid.Insert(i, pAgentData->pAgent, pAgentData->pos);
+            pAgentData->inStaticGrid = true;
+            pAgentData->staticGridPos = pAgentData->pos;
+        }
+    }
+}
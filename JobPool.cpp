@@ -0,0 +1,173 @@
+#include "JobPool.h"
+
+
+static uint64_t PackRange(uint32_t begin, uint32_t end)
+{
+    return begin | static_cast<uint64_t>(end) << 32;
+}
+
+
+JobPool::~JobPool()
+{
+    Stop();
+}
+
+
+void JobPool::Start(size_t nThreads)
+{
+    Stop();
+
+    m_bStop = false;
+    m_queues = std::make_unique<Queue[]>(nThreads + 1);
+    for (size_t i = 0; i < nThreads; i++) {
+        m_threads.emplace_back(&JobPool::WorkerLoop, this, i + 1);
+    }
+}
+
+void JobPool::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStop = true;
+    }
+    m_cvWork.notify_all();
+
+    for (auto& t : m_threads) {
+        t.join();
+    }
+    m_threads.clear();
+}
+
+
+void JobPool::ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &fn)
+{
+    if (!count)
+        return;
+    if (!grain)
+        grain = 1;
+
+    size_t chunks = (count + grain - 1) / grain;
+    if (chunks == 1 || m_threads.empty()) {
+        for (size_t i = 0; i < count; i += grain) {
+            fn(i, i + grain < count ? i + grain : count);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_fn = &fn;
+        m_count = count;
+        m_grain = grain;
+        m_pendingChunks = chunks;
+
+        // contiguous shares keep neighbouring entities on one thread
+        size_t nSlots = m_threads.size() + 1;
+        for (size_t i = 0; i < nSlots; i++) {
+            uint32_t begin = static_cast<uint32_t>(chunks * i / nSlots);
+            uint32_t end = static_cast<uint32_t>(chunks * (i + 1) / nSlots);
+            m_queues[i].range = PackRange(begin, end);
+        }
+        m_generation++;
+    }
+    m_cvWork.notify_all();
+
+    RunChunks(0);
+
+    // workers may still hold a reference to fn, so wait for them to leave as well
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cvDone.wait(lock, [this]{ return m_pendingChunks == 0 && m_activeWorkers == 0; });
+    m_fn = nullptr;
+}
+
+
+void JobPool::WorkerLoop(size_t slot)
+{
+    uint64_t lastGeneration = 0;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_cvWork.wait(lock, [&]{ return m_bStop || (m_generation != lastGeneration && m_fn); });
+        if (m_bStop)
+            return;
+
+        lastGeneration = m_generation;
+        m_activeWorkers++;
+        lock.unlock();
+
+        RunChunks(slot);
+
+        lock.lock();
+        m_activeWorkers--;
+        if (m_pendingChunks == 0 && m_activeWorkers == 0)
+            m_cvDone.notify_all();
+    }
+}
+
+void JobPool::RunChunks(size_t slot)
+{
+    uint32_t chunk;
+    do {
+        while (PopChunk(slot, chunk)) {
+            RunChunk(chunk);
+        }
+    } while (Steal(slot));
+}
+
+bool JobPool::PopChunk(size_t slot, uint32_t &chunk)
+{
+    auto& range = m_queues[slot].range;
+    uint64_t r = range.load();
+    while (true)
+    {
+        uint32_t begin = static_cast<uint32_t>(r);
+        uint32_t end = static_cast<uint32_t>(r >> 32);
+        if (begin >= end)
+            return false;
+        if (range.compare_exchange_weak(r, PackRange(begin + 1, end))) {
+            chunk = begin;
+            return true;
+        }
+    }
+}
+
+bool JobPool::Steal(size_t slot)
+{
+    // a chunk index is only ever in one range, so a range can not reappear with the same
+    // value and the exchange is safe from ABA
+    size_t nSlots = m_threads.size() + 1;
+    for (size_t n = 1; n < nSlots; n++)
+    {
+        auto& victim = m_queues[(slot + n) % nSlots].range;
+        uint64_t r = victim.load();
+        while (true)
+        {
+            uint32_t begin = static_cast<uint32_t>(r);
+            uint32_t end = static_cast<uint32_t>(r >> 32);
+            if (begin >= end)
+                break;
+
+            uint32_t split = end - (end - begin + 1) / 2;
+            if (victim.compare_exchange_weak(r, PackRange(begin, split))) {
+                // our own range is empty and thieves skip empty ranges, so nobody races this store
+                m_queues[slot].range = PackRange(split, end);
+                m_steals++;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void JobPool::RunChunk(uint32_t chunk)
+{
+    size_t begin = chunk * m_grain;
+    size_t end = begin + m_grain < m_count ? begin + m_grain : m_count;
+    (*m_fn)(begin, end);
+
+    if (--m_pendingChunks == 0) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cvDone.notify_all();
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef JOBPOOL_H
+#define JOBPOOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+
+// fixed set of worker threads that split index ranges between them.
+// every participant starts on its own share of the chunks and steals half of the remaining
+// chunks of another participant once it runs dry, so uneven chunks do not leave threads idle.
+// the calling thread takes part in the work and ParallelFor returns when every chunk is done.
+class JobPool
+{
+public:
+    ~JobPool();
+
+    void Start(size_t nThreads);
+    void Stop();
+
+    size_t GetThreadCount() const { return m_threads.size(); }
+    // chunk ranges taken from other participants since Start
+    uint64_t GetSteals() const { return m_steals; }
+
+    // calls fn(begin, end) for consecutive ranges of at most grain indices
+    void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &fn);
+
+private:
+    // chunk indices [begin, end) packed as begin | end << 32. the owner takes chunks from
+    // begin, thieves cut off the back half
+    struct alignas(64) Queue
+    {
+        std::atomic<uint64_t> range{0};
+    };
+
+    void WorkerLoop(size_t slot);
+    void RunChunks(size_t slot);
+    bool PopChunk(size_t slot, uint32_t &chunk);
+    bool Steal(size_t slot);
+    void RunChunk(uint32_t chunk);
+
+    std::vector<std::thread> m_threads;
+    // slot 0 belongs to the thread that calls ParallelFor, slot i + 1 to worker i
+    std::unique_ptr<Queue[]> m_queues;
+    std::mutex m_mutex;
+    std::condition_variable m_cvWork;
+    std::condition_variable m_cvDone;
+    bool m_bStop = false;
+    uint64_t m_generation = 0;
+    size_t m_activeWorkers = 0;
+
+    const std::function<void(size_t, size_t)> *m_fn = nullptr;
+    size_t m_count = 0;
+    size_t m_grain = 1;
+    std::atomic<size_t> m_pendingChunks;
+    std::atomic<uint64_t> m_steals{0};
+};
+
+#endif
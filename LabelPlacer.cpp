@@ -0,0 +1,129 @@
+#include "LabelPlacer.h"
+
+#include <cstdarg>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+
+// there is no way to measure text with the drawer, so labels are sized from the font height
+static const float CHAR_WIDTH = 0.55f;
+
+
+void LabelPlacer::Add(const hl::Font *pFont, float size, float x, float y, float priority, D3DCOLOR color, const char *text)
+{
+    Label label;
+    label.pFont = pFont;
+    label.rect.x0 = x;
+    label.rect.y0 = y;
+    label.rect.x1 = x + CHAR_WIDTH * size * strlen(text);
+    label.rect.y1 = y + size;
+    label.priority = priority;
+    label.color = color;
+    label.text = static_cast<uint32_t>(m_text.size());
+    m_labels.push_back(label);
+
+    m_text += text;
+    m_text += '\0';
+}
+
+
+static void DrawFontFormat(hl::Drawer *pDrawer, const hl::Font *pFont, float x, float y, D3DCOLOR color, const char *format, ...)
+{
+    va_list vl;
+    va_start(vl, format);
+    pDrawer->DrawFont(pFont, x, y, color, format, vl);
+    va_end(vl);
+}
+
+void LabelPlacer::Flush(hl::Drawer *pDrawer, GW2LIB::DrawStats &stats)
+{
+    if (m_labels.empty())
+        return;
+
+    if (m_buckets.empty())
+        m_buckets.resize(BUCKET_COUNT);
+
+    m_order.resize(m_labels.size());
+    for (size_t i = 0; i < m_order.size(); i++)
+        m_order[i] = static_cast<uint32_t>(i);
+    // stable, so equal priorities keep the order they were queued in
+    std::stable_sort(m_order.begin(), m_order.end(), [this](uint32_t a, uint32_t b) {
+        return m_labels[a].priority > m_labels[b].priority;
+    });
+
+    for (uint32_t i : m_order)
+    {
+        const Label &label = m_labels[i];
+        float h = label.rect.y1 - label.rect.y0;
+
+        // the anchor first, then one and two lines up and down
+        static const float offsets[] = { 0, -1, 1, -2, 2 };
+        bool bPlaced = false;
+        for (float offset : offsets)
+        {
+            Rect rect = label.rect;
+            rect.y0 += offset * h;
+            rect.y1 += offset * h;
+            if (!IsFree(rect))
+                continue;
+
+            Insert(rect);
+            DrawFontFormat(pDrawer, label.pFont, rect.x0, rect.y0, label.color, "%s", m_text.c_str() + label.text);
+            if (offset)
+                stats.labelsMoved++;
+            stats.labelsPlaced++;
+            bPlaced = true;
+            break;
+        }
+        if (!bPlaced)
+            stats.labelsDropped++;
+    }
+
+    for (size_t bucket : m_usedBuckets)
+        m_buckets[bucket].clear();
+    m_usedBuckets.clear();
+    m_placed.clear();
+    m_labels.clear();
+    m_text.clear();
+}
+
+bool LabelPlacer::IsFree(const Rect &rect) const
+{
+    for (int cy = Cell(rect.y0); cy <= Cell(rect.y1); cy++) {
+        for (int cx = Cell(rect.x0); cx <= Cell(rect.x1); cx++) {
+            // other cells share the bucket, so the rects are still compared
+            for (uint32_t i : m_buckets[Bucket(cx, cy)]) {
+                const Rect &other = m_placed[i];
+                if (rect.x0 < other.x1 && other.x0 < rect.x1 && rect.y0 < other.y1 && other.y0 < rect.y1)
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+void LabelPlacer::Insert(const Rect &rect)
+{
+    uint32_t index = static_cast<uint32_t>(m_placed.size());
+    m_placed.push_back(rect);
+
+    for (int cy = Cell(rect.y0); cy <= Cell(rect.y1); cy++) {
+        for (int cx = Cell(rect.x0); cx <= Cell(rect.x1); cx++) {
+            size_t bucket = Bucket(cx, cy);
+            if (m_buckets[bucket].empty())
+                m_usedBuckets.push_back(bucket);
+            m_buckets[bucket].push_back(index);
+        }
+    }
+}
+
+size_t LabelPlacer::Bucket(int cx, int cy)
+{
+    return (static_cast<uint32_t>(cx) * 73856093u ^ static_cast<uint32_t>(cy) * 19349663u) % BUCKET_COUNT;
+}
+
+int LabelPlacer::Cell(float v)
+{
+    return static_cast<int>(floor(v / CELL_SIZE));
+}
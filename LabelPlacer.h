@@ -0,0 +1,60 @@
+#ifndef LABELPLACER_H
+#define LABELPLACER_H
+
+#include "gw2lib.h"
+
+#include "hacklib/Drawer.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+// labels of one frame that must not overlap. in order of priority each label takes its anchor
+// or, if that is taken, a spot a line or two above or below it, otherwise it is dropped.
+// placed labels are kept in a spatial hash of screen cells so a label is only tested against
+// its neighbours. only used on the render thread
+class LabelPlacer
+{
+public:
+    // the text is copied, size is the height of the font in pixels
+    void Add(const hl::Font *pFont, float size, float x, float y, float priority, D3DCOLOR color, const char *text);
+
+    // places and draws the labels added since the last call and counts them in stats
+    void Flush(hl::Drawer *pDrawer, GW2LIB::DrawStats &stats);
+
+private:
+    static const int CELL_SIZE = 64;
+    static const size_t BUCKET_COUNT = 1024;
+
+    struct Rect
+    {
+        float x0, y0, x1, y1;
+    };
+
+    struct Label
+    {
+        const hl::Font *pFont;
+        Rect rect;
+        float priority;
+        D3DCOLOR color;
+        // offset into m_text
+        uint32_t text;
+    };
+
+    bool IsFree(const Rect &rect) const;
+    void Insert(const Rect &rect);
+    static size_t Bucket(int cx, int cy);
+    static int Cell(float v);
+
+    std::vector<Label> m_labels;
+    std::string m_text;
+    std::vector<uint32_t> m_order;
+
+    std::vector<Rect> m_placed;
+    // indices into m_placed by hashed cell, only the used buckets are cleared after a frame
+    std::vector<std::vector<uint32_t>> m_buckets;
+    std::vector<size_t> m_usedBuckets;
+};
+
+#endif
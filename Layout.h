@@ -0,0 +1,32 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include "gw2lib.h"
+#include "ReadPlan.h"
+
+
+namespace GameData
+{
+    // the capture and decode paths are templates over a layout. a layout provides the member
+    // offsets as mems and the read plans that were compiled from them
+
+    // the GW2LIB::Mems defaults of the build architecture. every offset is a constant expression,
+    // so the path instantiated over this layout has them encoded as immediates
+    struct StaticLayout
+    {
+        static constexpr GW2LIB::Mems mems = {};
+        CharacterReadPlan charPlan;
+        AgentReadPlan agentPlan;
+    };
+
+    // offsets passed to GW2LIB::SetMems, loaded from memory on every access. layouts are never
+    // freed, so capture frames in flight can keep a pointer to the one they were captured with
+    struct RuntimeLayout
+    {
+        GW2LIB::Mems mems;
+        CharacterReadPlan charPlan;
+        AgentReadPlan agentPlan;
+    };
+}
+
+#endif
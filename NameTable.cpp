@@ -0,0 +1,174 @@
+#include "NameTable.h"
+
+#include <emmintrin.h>
+#include <algorithm>
+#include <cstring>
+
+
+void GameData::Utf16ToUtf8(const wchar_t *in, size_t len, std::string &out)
+{
+    static_assert(sizeof(wchar_t) == 2, "utf-16 wchar_t expected");
+
+    size_t i = 0;
+    while (i < len)
+    {
+        // fast path: 8 code units that are all below 0x80
+        if (i + 8 <= len) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            __m128i high = _mm_and_si128(v, _mm_set1_epi16(static_cast<short>(0xff80)));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) == 0xffff) {
+                char packed[16];
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(packed), _mm_packus_epi16(v, v));
+                out.append(packed, 8);
+                i += 8;
+                continue;
+            }
+        }
+
+        uint32_t cp = static_cast<uint16_t>(in[i++]);
+        if (cp >= 0xd800 && cp <= 0xdbff) {
+            uint32_t lo = i < len ? static_cast<uint16_t>(in[i]) : 0;
+            if (lo >= 0xdc00 && lo <= 0xdfff) {
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                i++;
+            } else {
+                cp = 0xfffd;
+            }
+        } else if (cp >= 0xdc00 && cp <= 0xdfff) {
+            cp = 0xfffd;
+        }
+
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xc0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3f));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xe0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (cp & 0x3f));
+        } else {
+            out += static_cast<char>(0xf0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (cp & 0x3f));
+        }
+    }
+}
+
+
+void GameData::FoldName(std::string_view name, std::string &out)
+{
+    for (size_t i = 0; i < name.size(); i++)
+    {
+        unsigned char c = static_cast<unsigned char>(name[i]);
+        if (c >= 'A' && c <= 'Z') {
+            out += static_cast<char>(c + 0x20);
+        } else if (c == 0xc3 && i + 1 < name.size()) {
+            // U+00C0 - U+00DE except the multiplication sign
+            unsigned char c2 = static_cast<unsigned char>(name[++i]);
+            if (c2 >= 0x80 && c2 <= 0x9e && c2 != 0x97)
+                c2 += 0x20;
+            out += static_cast<char>(c);
+            out += static_cast<char>(c2);
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+}
+
+
+GameData::NameTable::NameTable()
+{
+    // id 0 is the empty name
+    m_entries.push_back(std::string_view());
+    m_folded.push_back(std::string());
+}
+
+GameData::NameId GameData::NameTable::Intern(const wchar_t *utf16, size_t len)
+{
+    if (!len)
+        return NAME_NONE;
+
+    m_scratch.clear();
+    Utf16ToUtf8(utf16, len, m_scratch);
+
+    // only this thread modifies the table, so looking up needs no lock
+    auto it = m_lookup.find(m_scratch);
+    if (it != m_lookup.end())
+        return it->second;
+
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    size_t size = m_scratch.size();
+    if (m_chunkUsed + size > CHUNK_SIZE) {
+        m_chunks.push_back(std::make_unique<char[]>(size > CHUNK_SIZE ? size : CHUNK_SIZE));
+        m_chunkUsed = 0;
+    }
+    char *dst = m_chunks.back().get() + m_chunkUsed;
+    memcpy(dst, m_scratch.data(), size);
+    m_chunkUsed += size;
+
+    NameId id = static_cast<NameId>(m_entries.size());
+    m_entries.push_back(std::string_view(dst, size));
+    m_lookup[m_entries.back()] = id;
+
+    // new names are rare, so keeping the index sorted on insert is cheaper than sorting per lookup
+    std::string folded;
+    FoldName(m_entries.back(), folded);
+    auto pos = std::lower_bound(m_sorted.begin(), m_sorted.end(), folded, [this](NameId a, const std::string &b) {
+        return m_folded[a] < b;
+    });
+    m_sorted.insert(pos, id);
+    m_folded.push_back(std::move(folded));
+
+    return id;
+}
+
+std::string_view GameData::NameTable::Get(NameId id) const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    if (id < m_entries.size())
+        return m_entries[id];
+    return std::string_view();
+}
+
+GameData::NameId GameData::NameTable::Find(std::string_view name) const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    auto it = m_lookup.find(name);
+    if (it != m_lookup.end())
+        return it->second;
+    return NAME_NONE;
+}
+
+void GameData::NameTable::FindPrefix(std::string_view prefix, bool ignoreCase, std::vector<NameId> &out) const
+{
+    std::string folded;
+    FoldName(prefix, folded);
+
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    auto it = std::lower_bound(m_sorted.begin(), m_sorted.end(), folded, [this](NameId a, const std::string &b) {
+        return m_folded[a] < b;
+    });
+    for (; it != m_sorted.end(); ++it)
+    {
+        const std::string &candidate = m_folded[*it];
+        if (candidate.compare(0, folded.size(), folded) != 0)
+            break;
+        if (!ignoreCase && m_entries[*it].compare(0, prefix.size(), prefix) != 0)
+            continue;
+        out.push_back(*it);
+    }
+}
+
+void GameData::NameTable::Clear()
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_chunks.clear();
+    m_chunkUsed = CHUNK_SIZE;
+    m_entries.resize(1);
+    m_folded.resize(1);
+    m_sorted.clear();
+    m_lookup.clear();
+}
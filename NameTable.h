@@ -0,0 +1,61 @@
+#ifndef NAMETABLE_H
+#define NAMETABLE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <shared_mutex>
+#include <cstdint>
+
+
+namespace GameData
+{
+    typedef uint32_t NameId;
+    static const NameId NAME_NONE = 0;
+
+    // appends the utf-8 form of len utf-16 code units to out. ascii runs are converted
+    // 8 code units at a time, unpaired surrogates become U+FFFD
+    void Utf16ToUtf8(const wchar_t *in, size_t len, std::string &out);
+
+    // appends a case folded copy of a utf-8 name to out. folds ascii and latin-1 letters,
+    // which covers the characters the game allows in names
+    void FoldName(std::string_view name, std::string &out);
+
+    // deduplicated utf-8 strings. the bytes never move once interned, so views stay valid
+    // until Clear is called. a case folded sorted index is kept alongside for prefix lookups.
+    // Intern must only be called from one thread, lookups may come from any thread
+    class NameTable
+    {
+    public:
+        NameTable();
+
+        NameId Intern(const wchar_t *utf16, size_t len);
+        std::string_view Get(NameId id) const;
+
+        // id of an already interned name or NAME_NONE, never interns
+        NameId Find(std::string_view name) const;
+        // appends the ids of all names starting with prefix in case folded order
+        void FindPrefix(std::string_view prefix, bool ignoreCase, std::vector<NameId> &out) const;
+
+        void Clear();
+
+    private:
+        static const size_t CHUNK_SIZE = 4096;
+
+        std::vector<std::unique_ptr<char[]>> m_chunks;
+        size_t m_chunkUsed = CHUNK_SIZE;
+        std::vector<std::string_view> m_entries;
+        // case folded names by id and ids sorted by folded name
+        std::vector<std::string> m_folded;
+        std::vector<NameId> m_sorted;
+        std::unordered_map<std::string_view, NameId> m_lookup;
+        std::string m_scratch;
+        // held exclusively while a new name is added
+        mutable std::shared_mutex m_mutex;
+    };
+}
+
+#endif
@@ -0,0 +1,114 @@
+#include "PageCache.h"
+
+#include <Windows.h>
+#include <algorithm>
+
+
+static bool IsReadableRegion(const MEMORY_BASIC_INFORMATION &mbi)
+{
+    if (mbi.State != MEM_COMMIT || (mbi.Protect & (PAGE_GUARD | PAGE_NOACCESS)))
+        return false;
+    return (mbi.Protect & (PAGE_READONLY | PAGE_READWRITE | PAGE_WRITECOPY |
+        PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)) != 0;
+}
+
+
+void GameData::PageCache::Rebuild()
+{
+    m_regions.clear();
+    m_misses = 0;
+
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+
+    uintptr_t addr = reinterpret_cast<uintptr_t>(si.lpMinimumApplicationAddress);
+    uintptr_t maxAddr = reinterpret_cast<uintptr_t>(si.lpMaximumApplicationAddress);
+
+    MEMORY_BASIC_INFORMATION mbi;
+    while (addr < maxAddr && VirtualQuery(reinterpret_cast<void*>(addr), &mbi, sizeof(mbi)) == sizeof(mbi))
+    {
+        uintptr_t begin = reinterpret_cast<uintptr_t>(mbi.BaseAddress);
+        uintptr_t end = begin + mbi.RegionSize;
+
+        if (IsReadableRegion(mbi)) {
+            // the walk is in address order, so merging with the last region is enough
+            if (!m_regions.empty() && m_regions.back().end == begin)
+                m_regions.back().end = end;
+            else
+                m_regions.push_back({ begin, end });
+        }
+
+        if (end <= addr)
+            break;
+        addr = end;
+    }
+}
+
+void GameData::PageCache::Clear()
+{
+    m_regions.clear();
+    m_misses = 0;
+}
+
+bool GameData::PageCache::IsReadable(const void *p, size_t size)
+{
+    uintptr_t begin = reinterpret_cast<uintptr_t>(p);
+    uintptr_t end = begin + size;
+    if (!p || end < begin)
+        return false;
+
+    if (Contains(begin, end))
+        return true;
+
+    m_misses++;
+
+    // the range may also span several regions that were not merged, query each of them
+    uintptr_t addr = begin;
+    while (addr < end)
+    {
+        MEMORY_BASIC_INFORMATION mbi;
+        if (VirtualQuery(reinterpret_cast<void*>(addr), &mbi, sizeof(mbi)) != sizeof(mbi) || !IsReadableRegion(mbi))
+            return false;
+
+        Region region = { reinterpret_cast<uintptr_t>(mbi.BaseAddress), reinterpret_cast<uintptr_t>(mbi.BaseAddress) + mbi.RegionSize };
+        Insert(region);
+        addr = region.end;
+    }
+    return true;
+}
+
+bool GameData::PageCache::Contains(uintptr_t begin, uintptr_t end) const
+{
+    // last region that starts at or before begin
+    auto it = std::upper_bound(m_regions.begin(), m_regions.end(), begin, [](uintptr_t addr, const Region &r) {
+        return addr < r.begin;
+    });
+    if (it == m_regions.begin())
+        return false;
+    --it;
+    return end <= it->end;
+}
+
+void GameData::PageCache::Insert(Region region)
+{
+    if (Contains(region.begin, region.end))
+        return;
+
+    auto it = std::lower_bound(m_regions.begin(), m_regions.end(), region.begin, [](const Region &r, uintptr_t addr) {
+        return r.begin < addr;
+    });
+    // regions come from VirtualQuery and do not overlap, only merge exact neighbours
+    if (it != m_regions.begin() && (it-1)->end == region.begin) {
+        (it-1)->end = region.end;
+        if (it != m_regions.end() && it->begin == region.end) {
+            (it-1)->end = it->end;
+            m_regions.erase(it);
+        }
+        return;
+    }
+    if (it != m_regions.end() && it->begin == region.end) {
+        it->begin = region.begin;
+        return;
+    }
+    m_regions.insert(it, region);
+}
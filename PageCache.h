@@ -0,0 +1,42 @@
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <vector>
+#include <cstdint>
+
+
+namespace GameData
+{
+    // committed readable address ranges of the process, used to reject foreign pointers before
+    // they are dereferenced. Rebuild walks the whole memory map and is meant for a background
+    // thread. a lookup that misses asks VirtualQuery for that one region and remembers it, so
+    // memory allocated after the last rebuild is only slow once
+    class PageCache
+    {
+    public:
+        void Rebuild();
+        void Clear();
+
+        bool IsReadable(const void *p, size_t size);
+
+        size_t GetRegionCount() const { return m_regions.size(); }
+        // lookups since the last rebuild that had to call VirtualQuery
+        int GetMisses() const { return m_misses; }
+
+    private:
+        struct Region
+        {
+            uintptr_t begin;
+            uintptr_t end;
+        };
+
+        bool Contains(uintptr_t begin, uintptr_t end) const;
+        void Insert(Region region);
+
+        // sorted by begin, adjacent readable regions are merged
+        std::vector<Region> m_regions;
+        int m_misses = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,184 @@
+#include "PrimitiveBatch.h"
+
+#include <cstring>
+
+
+static D3DXVECTOR3 WorldOrigin(const D3DXMATRIX &world)
+{
+    return D3DXVECTOR3(world._41, world._42, world._43);
+}
+
+// largest scale of the three axes, keeps the sphere conservative for non uniform scaling
+static float WorldScale(const D3DXMATRIX &world)
+{
+    float sx = world._11*world._11 + world._12*world._12 + world._13*world._13;
+    float sy = world._21*world._21 + world._22*world._22 + world._23*world._23;
+    float sz = world._31*world._31 + world._32*world._32 + world._33*world._33;
+    float s = sx > sy ? sx : sy;
+    return sqrt(s > sz ? s : sz);
+}
+
+
+void PrimitiveBatch::Begin(hl::Drawer *pDrawer, const Frustum &frustum, const D3DXVECTOR3 &camPos, float pixelScale, bool bSort)
+{
+    m_pDrawer = pDrawer;
+    m_frustum = frustum;
+    m_camPos = camPos;
+    m_pixelScale = pixelScale;
+    m_bSort = bSort;
+    m_stats = {};
+    m_items.clear();
+}
+
+void PrimitiveBatch::Add(const hl::VertexBuffer *vb, const hl::IndexBuffer *ib, D3DPRIMITIVETYPE type, const D3DXMATRIX &world, float radius)
+{
+    AddItem({ vb, ib, type, false, 0, radius, world });
+}
+
+void PrimitiveBatch::Add(const hl::VertexBuffer *vb, const hl::IndexBuffer *ib, D3DPRIMITIVETYPE type, const D3DXMATRIX &world, float radius, D3DCOLOR color)
+{
+    AddItem({ vb, ib, type, true, color, radius, world });
+}
+
+void PrimitiveBatch::AddItem(const Item &item)
+{
+    if (m_bSort) {
+        m_items.push_back(item);
+        return;
+    }
+
+    if (!m_frustum.IsSphereVisible(WorldOrigin(item.world), item.radius * WorldScale(item.world))) {
+        m_stats.primitivesCulled++;
+        return;
+    }
+    Draw(item);
+}
+
+void PrimitiveBatch::AddLine(D3DXVECTOR3 pos1, D3DXVECTOR3 pos2, D3DCOLOR color)
+{
+    bool bClipped;
+    if (!m_frustum.ClipLine(pos1, pos2, bClipped)) {
+        m_stats.linesCulled++;
+        return;
+    }
+    if (bClipped)
+        m_stats.linesClipped++;
+    m_pDrawer->DrawLineProjected(pos1, pos2, color);
+}
+
+void PrimitiveBatch::AddShape(ShapeType type, float param, const D3DXMATRIX &world, D3DCOLOR color)
+{
+    D3DXVECTOR3 diff = WorldOrigin(world) - m_camPos;
+    float dist = D3DXVec3Length(&diff);
+    float screenRadius = WorldScale(world) * m_pixelScale / (dist > 1.0f ? dist : 1.0f);
+
+    const hl::VertexBuffer *vb = m_shapes.Get(m_pDrawer, type, ShapeCache::SelectLod(screenRadius), param);
+    if (vb)
+        Add(vb, nullptr, ShapeCache::GetPrimitiveType(type), world, 1.0f, color);
+}
+
+void PrimitiveBatch::Draw(const Item &item)
+{
+    if (item.bColored)
+        m_pDrawer->DrawPrimitive(item.vb, item.ib, item.type, item.world, item.color);
+    else
+        m_pDrawer->DrawPrimitive(item.vb, item.ib, item.type, item.world);
+    m_stats.primitivesDrawn++;
+}
+
+void PrimitiveBatch::Flush()
+{
+    if (m_items.empty())
+        return;
+
+    CullItems();
+    SortBackToFront();
+
+    for (uint32_t i : m_order) {
+        Draw(m_items[i]);
+    }
+
+    m_items.clear();
+}
+
+void PrimitiveBatch::CullItems()
+{
+    size_t n = m_items.size();
+    size_t padded = (n + 3) & ~static_cast<size_t>(3);
+    m_sphereX.resize(padded);
+    m_sphereY.resize(padded);
+    m_sphereZ.resize(padded);
+    m_sphereR.resize(padded);
+    m_visible.resize(padded);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        const D3DXMATRIX &world = m_items[i].world;
+        m_sphereX[i] = world._41;
+        m_sphereY[i] = world._42;
+        m_sphereZ[i] = world._43;
+        m_sphereR[i] = m_items[i].radius * WorldScale(world);
+    }
+    for (size_t i = n; i < padded; i++) {
+        m_sphereX[i] = m_sphereY[i] = m_sphereZ[i] = m_sphereR[i] = 0;
+    }
+
+    m_frustum.CullSpheres(m_sphereX.data(), m_sphereY.data(), m_sphereZ.data(), m_sphereR.data(), n, m_visible.data());
+}
+
+void PrimitiveBatch::SortBackToFront()
+{
+    m_keys.clear();
+    m_order.clear();
+
+    // squared distances are positive floats, their bits order like unsigned ints. inverting
+    // them turns the ascending sort into farthest first
+    for (size_t i = 0; i < m_items.size(); i++)
+    {
+        if (!m_visible[i]) {
+            m_stats.primitivesCulled++;
+            continue;
+        }
+
+        D3DXVECTOR3 diff = WorldOrigin(m_items[i].world) - m_camPos;
+        float dist2 = D3DXVec3LengthSq(&diff);
+        uint32_t bits;
+        memcpy(&bits, &dist2, sizeof(bits));
+        m_keys.push_back(~bits);
+        m_order.push_back(static_cast<uint32_t>(i));
+    }
+
+    size_t n = m_keys.size();
+    if (!n)
+        return;
+    m_keysTmp.resize(n);
+    m_orderTmp.resize(n);
+
+    // stable lsd radix sort, one pass per byte
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        uint32_t counts[256] = {};
+        for (size_t i = 0; i < n; i++)
+            counts[(m_keys[i] >> shift) & 0xff]++;
+
+        // nothing moves if every key has the same byte here
+        if (counts[(m_keys[0] >> shift) & 0xff] == n)
+            continue;
+
+        uint32_t offset = 0;
+        for (auto& count : counts) {
+            uint32_t c = count;
+            count = offset;
+            offset += c;
+        }
+
+        for (size_t i = 0; i < n; i++)
+        {
+            uint32_t dst = counts[(m_keys[i] >> shift) & 0xff]++;
+            m_keysTmp[dst] = m_keys[i];
+            m_orderTmp[dst] = m_order[i];
+        }
+        std::swap(m_keys, m_keysTmp);
+        std::swap(m_order, m_orderTmp);
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef PRIMITIVEBATCH_H
+#define PRIMITIVEBATCH_H
+
+#include "gw2lib.h"
+#include "Frustum.h"
+#include "ShapeCache.h"
+
+#include "hacklib/Drawer.h"
+
+#include "d3dx9.h"
+#include <vector>
+#include <cstdint>
+
+
+// projected draws of one frame. primitives and lines outside the view frustum are dropped and
+// lines are clipped at the near plane. with depth sorting, primitives are held until Flush and
+// drawn back to front so translucent geometry blends in the right order, otherwise they are
+// drawn right away. only used on the render thread
+class PrimitiveBatch
+{
+public:
+    // pixelScale is the size in pixels of one unit at distance one from the camera
+    void Begin(hl::Drawer *pDrawer, const Frustum &frustum, const D3DXVECTOR3 &camPos, float pixelScale, bool bSort);
+
+    // radius of a sphere around the origin of the primitive that contains all of it
+    void Add(const hl::VertexBuffer *vb, const hl::IndexBuffer *ib, D3DPRIMITIVETYPE type, const D3DXMATRIX &world, float radius);
+    void Add(const hl::VertexBuffer *vb, const hl::IndexBuffer *ib, D3DPRIMITIVETYPE type, const D3DXMATRIX &world, float radius, D3DCOLOR color);
+    void AddLine(D3DXVECTOR3 pos1, D3DXVECTOR3 pos2, D3DCOLOR color);
+    // unit shape placed by world, tessellated according to its size on screen
+    void AddShape(ShapeType type, float param, const D3DXMATRIX &world, D3DCOLOR color);
+
+    // culls the held primitives in batches, sorts them by the distance of their origins to
+    // the camera and draws them
+    void Flush();
+
+    const GW2LIB::DrawStats &GetStats() const { return m_stats; }
+    ShapeCache *GetShapeCache() { return &m_shapes; }
+
+private:
+    struct Item
+    {
+        const hl::VertexBuffer *vb;
+        const hl::IndexBuffer *ib;
+        D3DPRIMITIVETYPE type;
+        bool bColored;
+        D3DCOLOR color;
+        float radius;
+        D3DXMATRIX world;
+    };
+
+    void AddItem(const Item &item);
+    void Draw(const Item &item);
+    void CullItems();
+    void SortBackToFront();
+
+    hl::Drawer *m_pDrawer = nullptr;
+    Frustum m_frustum;
+    D3DXVECTOR3 m_camPos = D3DXVECTOR3(0, 0, 0);
+    float m_pixelScale = 0;
+    bool m_bSort = false;
+    GW2LIB::DrawStats m_stats = {};
+    ShapeCache m_shapes;
+
+    std::vector<Item> m_items;
+    // bounding spheres of m_items as arrays for the frustum, padded to a multiple of 4
+    std::vector<float> m_sphereX;
+    std::vector<float> m_sphereY;
+    std::vector<float> m_sphereZ;
+    std::vector<float> m_sphereR;
+    std::vector<uint8_t> m_visible;
+    // sort keys and indices of visible items, the tmp vectors are the scatter targets of the radix passes
+    std::vector<uint32_t> m_keys;
+    std::vector<uint32_t> m_order;
+    std::vector<uint32_t> m_keysTmp;
+    std::vector<uint32_t> m_orderTmp;
+};
+
+#endif
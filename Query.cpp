@@ -0,0 +1,202 @@
+#include "main.h"
+
+#include <emmintrin.h>
+#include <intrin.h>
+
+
+using namespace GW2LIB;
+
+
+CharacterQuery &CharacterQuery::Is(CharacterFlag flag)
+{
+    Add({ PRED_FLAG, flag, Vector3(0, 0, 0), 0 });
+    return *this;
+}
+
+CharacterQuery &CharacterQuery::IsNot(CharacterFlag flag)
+{
+    Add({ PRED_NOT_FLAG, flag, Vector3(0, 0, 0), 0 });
+    return *this;
+}
+
+CharacterQuery &CharacterQuery::LevelAtLeast(int level)
+{
+    Add({ PRED_LEVEL_MIN, level, Vector3(0, 0, 0), 0 });
+    return *this;
+}
+
+CharacterQuery &CharacterQuery::LevelAtMost(int level)
+{
+    Add({ PRED_LEVEL_MAX, level, Vector3(0, 0, 0), 0 });
+    return *this;
+}
+
+CharacterQuery &CharacterQuery::ProfessionIs(GW2::Profession profession)
+{
+    Add({ PRED_PROFESSION, profession, Vector3(0, 0, 0), 0 });
+    return *this;
+}
+
+CharacterQuery &CharacterQuery::WithinDistance(Vector3 pos, float range)
+{
+    Add({ PRED_DISTANCE, 0, pos, range });
+    return *this;
+}
+
+CharacterQuery &CharacterQuery::Or()
+{
+    // an alternative without predicates would match everything, so empty groups are reused
+    if (!m_groups.empty() && !m_groups.back().empty())
+        m_groups.emplace_back();
+    return *this;
+}
+
+void CharacterQuery::Add(const Predicate &pred)
+{
+    if (m_groups.empty())
+        m_groups.emplace_back();
+    m_groups.back().push_back(pred);
+}
+
+
+// each function fills one 32 bit result word from 8 sse vectors of the column
+// inclusive compare, equality is tested separately so the bound is never offset and cannot overflow
+static uint32_t CompareIntWord(const int *col, int cmp, bool greater)
+{
+    __m128i vcmp = _mm_set1_epi32(cmp);
+    uint32_t word = 0;
+    for (int i = 0; i < 8; i++) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(col + i*4));
+        __m128i res = greater ? _mm_cmpgt_epi32(v, vcmp) : _mm_cmplt_epi32(v, vcmp);
+        res = _mm_or_si128(res, _mm_cmpeq_epi32(v, vcmp));
+        word |= static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(res))) << (i*4);
+    }
+    return word;
+}
+
+static uint32_t EqualIntWord(const int *col, int cmp)
+{
+    __m128i vcmp = _mm_set1_epi32(cmp);
+    uint32_t word = 0;
+    for (int i = 0; i < 8; i++) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(col + i*4));
+        __m128i res = _mm_cmpeq_epi32(v, vcmp);
+        word |= static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(res))) << (i*4);
+    }
+    return word;
+}
+
+static uint32_t DistanceWord(const float *x, const float *y, const float *z, Vector3 pos, float range)
+{
+    __m128 px = _mm_set1_ps(pos.x);
+    __m128 py = _mm_set1_ps(pos.y);
+    __m128 pz = _mm_set1_ps(pos.z);
+    __m128 r2 = _mm_set1_ps(range*range);
+    uint32_t word = 0;
+    for (int i = 0; i < 8; i++) {
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i*4), px);
+        __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i*4), py);
+        __m128 dz = _mm_sub_ps(_mm_loadu_ps(z + i*4), pz);
+        __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        word |= static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(d2, r2))) << (i*4);
+    }
+    return word;
+}
+
+
+std::vector<size_t> CharacterQuery::ExecuteIndices() const
+{
+    const auto& cols = GetMain()->GetGameData()->charColumns;
+
+    // bits of all characters in the column
+    std::vector<uint32_t> all(cols.words);
+    for (size_t w = 0; w < cols.words; w++) {
+        size_t remaining = cols.count - w*32;
+        all[w] = remaining >= 32 ? 0xffffffff : ((1u << remaining) - 1);
+    }
+
+    // a query without predicates matches every character
+    bool bEmpty = true;
+    for (const auto& preds : m_groups) {
+        if (!preds.empty())
+            bEmpty = false;
+    }
+
+    std::vector<uint32_t> result(bEmpty ? all : std::vector<uint32_t>(cols.words, 0));
+    std::vector<uint32_t> group(cols.words);
+
+    for (const auto& preds : m_groups)
+    {
+        if (preds.empty())
+            continue;
+
+        group = all;
+
+        for (const auto& pred : preds)
+        {
+            for (size_t w = 0; w < cols.words; w++)
+            {
+                if (!group[w])
+                    continue;
+
+                size_t base = w*32;
+                switch (pred.type) {
+                case PRED_FLAG:
+                    group[w] &= cols.flags[pred.flagOrValue][w];
+                    break;
+                case PRED_NOT_FLAG:
+                    group[w] &= ~cols.flags[pred.flagOrValue][w];
+                    break;
+                case PRED_LEVEL_MIN:
+                    group[w] &= CompareIntWord(&cols.level[base], pred.flagOrValue, true);
+                    break;
+                case PRED_LEVEL_MAX:
+                    group[w] &= CompareIntWord(&cols.level[base], pred.flagOrValue, false);
+                    break;
+                case PRED_PROFESSION:
+                    group[w] &= EqualIntWord(&cols.profession[base], pred.flagOrValue);
+                    break;
+                case PRED_DISTANCE:
+                    group[w] &= cols.flags[CHAR_FLAG_HAS_AGENT][w];
+                    group[w] &= DistanceWord(&cols.posX[base], &cols.posY[base], &cols.posZ[base], pred.pos, pred.range);
+                    break;
+                }
+            }
+        }
+
+        for (size_t w = 0; w < cols.words; w++) {
+            result[w] |= group[w];
+        }
+    }
+
+    std::vector<size_t> indices;
+    for (size_t w = 0; w < cols.words; w++)
+    {
+        uint32_t word = result[w];
+        while (word) {
+            unsigned long bit;
+            _BitScanForward(&bit, word);
+            indices.push_back(w*32 + bit);
+            word &= word - 1;
+        }
+    }
+    return indices;
+}
+
+std::vector<Character> CharacterQuery::Execute() const
+{
+    const auto& chars = GetMain()->GetGameData()->objData.charDataList;
+
+    std::vector<Character> result;
+    for (size_t i : ExecuteIndices()) {
+        Character chr;
+        chr.m_ptr = chars[i].get();
+        result.push_back(chr);
+    }
+    return result;
+}
+
+size_t CharacterQuery::Count() const
+{
+    return ExecuteIndices().size();
+}
@@ -0,0 +1,79 @@
+#include "ReadPlan.h"
+
+#include "hacklib/Logging.h"
+
+#include <xmmintrin.h>
+
+
+static const size_t CACHE_LINE = 64;
+
+
+void GameData::ReadSpan::prefetch(const void *object) const
+{
+    // prefetching never faults, so this is fine on stale pointers
+    const char *p = reinterpret_cast<const char*>(object) + begin;
+    for (size_t i = 0; i < size; i += CACHE_LINE) {
+        _mm_prefetch(p + i, _MM_HINT_T0);
+    }
+}
+
+
+static void Layout(GameData::ReadSpan &span, size_t &stagingSize, const char *name)
+{
+    if (span.size > GameData::READ_SPAN_SANE_SIZE) {
+        HL_LOG_ERR("[ReadPlan] span of %s is 0x%x bytes, check the offsets\n", name, (unsigned)span.size);
+    }
+    // keep every span cache line aligned inside the staging buffer
+    span.stagingOffset = stagingSize;
+    stagingSize += (span.size + CACHE_LINE - 1) & ~(CACHE_LINE - 1);
+}
+
+
+GameData::CharacterReadPlan GameData::CompileCharacterReadPlan(const GW2LIB::Mems &mems)
+{
+    CharacterReadPlan plan;
+
+    plan.character.include(mems.charAttitude, sizeof(int));
+    plan.character.include(mems.charGliderPercent, sizeof(float));
+    plan.character.include(mems.charHealth, sizeof(void*));
+    plan.character.include(mems.charEndurance, sizeof(void*));
+    plan.character.include(mems.charCoreStats, sizeof(void*));
+    plan.character.include(mems.charInventory, sizeof(void*));
+    plan.character.include(mems.charBreakbar, sizeof(void*));
+
+    plan.health.include(mems.healthCurrent, sizeof(float));
+    plan.health.include(mems.healthMax, sizeof(float));
+
+    plan.endurance.include(mems.endCurrent, sizeof(int));
+    plan.endurance.include(mems.endMax, sizeof(int));
+
+    plan.coreStats.include(mems.statsLevel, sizeof(int));
+    plan.coreStats.include(mems.statsScaledLevel, sizeof(int));
+    plan.coreStats.include(mems.statsProfession, sizeof(int));
+
+    plan.inventory.include(mems.invSupply, sizeof(int));
+
+    plan.breakbar.include(mems.breakbarState, sizeof(int));
+    plan.breakbar.include(mems.breakbarPercent, sizeof(float));
+
+    Layout(plan.character, plan.stagingSize, "character");
+    Layout(plan.health, plan.stagingSize, "health");
+    Layout(plan.endurance, plan.stagingSize, "endurance");
+    Layout(plan.coreStats, plan.stagingSize, "corestats");
+    Layout(plan.inventory, plan.stagingSize, "inventory");
+    Layout(plan.breakbar, plan.stagingSize, "breakbar");
+
+    return plan;
+}
+
+GameData::AgentReadPlan GameData::CompileAgentReadPlan(const GW2LIB::Mems &mems)
+{
+    AgentReadPlan plan;
+
+    plan.transform.include(mems.agtransRX, sizeof(float));
+    plan.transform.include(mems.agtransRY, sizeof(float));
+
+    Layout(plan.transform, plan.stagingSize, "transform");
+
+    return plan;
+}
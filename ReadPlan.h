@@ -0,0 +1,69 @@
+#ifndef READPLAN_H
+#define READPLAN_H
+
+#include "gw2lib.h"
+
+#include <cstring>
+
+
+namespace GameData
+{
+    // byte range of a foreign object that covers every field we decode from it.
+    // the range is copied with a single memcpy into a staging buffer at stagingOffset.
+    struct ReadSpan
+    {
+        uintptr_t begin = 0;
+        size_t size = 0;
+        size_t stagingOffset = 0;
+
+        void include(uintptr_t offset, size_t n) {
+            if (!size) {
+                begin = offset;
+                size = n;
+                return;
+            }
+            uintptr_t end = begin + size;
+            if (offset < begin) begin = offset;
+            if (offset + n > end) end = offset + n;
+            size = end - begin;
+        }
+
+        void copy(uint8_t *staging, const void *object) const {
+            memcpy(staging + stagingOffset, reinterpret_cast<const uint8_t*>(object) + begin, size);
+        }
+
+        void prefetch(const void *object) const;
+
+        template <typename T>
+        T decode(const uint8_t *staging, uintptr_t offset) const {
+            T value;
+            memcpy(&value, staging + stagingOffset + (offset - begin), sizeof(T));
+            return value;
+        }
+    };
+
+    struct CharacterReadPlan
+    {
+        ReadSpan character;
+        ReadSpan health;
+        ReadSpan endurance;
+        ReadSpan coreStats;
+        ReadSpan inventory;
+        ReadSpan breakbar;
+        size_t stagingSize = 0;
+    };
+
+    struct AgentReadPlan
+    {
+        ReadSpan transform;
+        size_t stagingSize = 0;
+    };
+
+    // spans larger than this most likely come from a broken offset after a game update
+    static const size_t READ_SPAN_SANE_SIZE = 0x1000;
+
+    CharacterReadPlan CompileCharacterReadPlan(const GW2LIB::Mems &mems);
+    AgentReadPlan CompileAgentReadPlan(const GW2LIB::Mems &mems);
+}
+
+#endif
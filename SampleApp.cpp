@@ -1,7 +1,5 @@
 #include "gw2lib.h"
 #include <sstream>
-#include <thread>
-#include <chrono>
 
 
 GW2LIB::Font font;
@@ -47,13 +45,21 @@ void cbESP()
         if (dist(mypos, pos) > 2000.0f)
             continue;
 
+        // labels only for the agents that are worth it this frame, see SetEspBudget
+        EspLod lod = ag.GetEspLod();
+        if (lod == ESP_LOD_HIDDEN)
+            continue;
+        bool labels = lod == ESP_LOD_FULL;
+
         float x, y;
         if (WorldToScreen(pos, &x, &y)) {
-            font.Draw(x, y, fontColor, "pos: %.1f %.1f %.1f", pos.x, pos.y, pos.z);
-            font.Draw(x, y-15, fontColor, "agentId: %i / 0x%04X", ag.GetAgentId(), ag.GetAgentId());
-            font.Draw(x, y-45, fontColor, "category: %i, type: %i", ag.GetCategory(), ag.GetType());
+            if (labels) {
+                font.Draw(x, y, fontColor, "pos: %.1f %.1f %.1f", pos.x, pos.y, pos.z);
+                font.Draw(x, y-15, fontColor, "agentId: %i / 0x%04X", ag.GetAgentId(), ag.GetAgentId());
+                font.Draw(x, y-45, fontColor, "category: %i, type: %i", ag.GetCategory(), ag.GetType());
+            }
 
-            if (ag.IsValid())
+            if (labels && ag.IsValid())
             {
                 font.Draw(x, y-30, fontColor, "agentptr: %p", *(void**)ag.m_ptr);
 
@@ -73,10 +79,12 @@ void cbESP()
 
             if (chr.IsValid())
             {
-                font.Draw(x, y-60, fontColor, chr.GetName());
-                font.Draw(x, y-75, fontColor, "charPtr: %p - %s", *(void**)chr.m_ptr, strProf[chr.GetProfession()].c_str());
-                font.Draw(x, y-90, fontColor, "level: %i (actual: %i)", chr.GetScaledLevel(), chr.GetLevel());
-                font.Draw(x, y-105, fontColor, "wvw supply: %i", chr.GetWvwSupply());
+                if (labels) {
+                    font.Draw(x, y-60, fontColor, chr.GetName());
+                    font.Draw(x, y-75, fontColor, "charPtr: %p - %s", *(void**)chr.m_ptr, strProf[chr.GetProfession()].c_str());
+                    font.Draw(x, y-90, fontColor, "level: %i (actual: %i)", chr.GetScaledLevel(), chr.GetLevel());
+                    font.Draw(x, y-105, fontColor, "wvw supply: %i", chr.GetWvwSupply());
+                }
 
                 color = 0xcc000000;
 
@@ -107,6 +115,11 @@ void cbESP()
                 circleSize = 20;
             }
 
+            if (lod == ESP_LOD_DOT) {
+                DrawCircleFilled(x, y, 2, color);
+                continue;
+            }
+
             Vector3 rotArrow = {
                 pos.x + cos(ag.GetRot()) * 50.0f,
                 pos.y + sin(ag.GetRot()) * 50.0f,
@@ -124,6 +137,7 @@ void cbESP()
 void GW2LIB::gw2lib_main()
 {
     EnableEsp(cbESP);
+    SetEspBudget(2000, 2000.0f);
     if (!font.Init(12, "Arial"))
     {
         //DbgOut("could not create font");
@@ -131,5 +145,5 @@ void GW2LIB::gw2lib_main()
     }
 
     while (GetAsyncKeyState(VK_HOME) >= 0)
-        std::this_thread::sleep_for(std::chrono::milliseconds(25));
+        WaitForNextTick();
 }
\ No newline at end of file
@@ -0,0 +1,28 @@
+#include "SequenceSignal.h"
+
+
+void SequenceSignal::Signal()
+{
+    m_sequence++;
+
+    // a waiter registers before it checks the counter, so either it sees the new value or
+    // we see the waiter. taking the mutex makes sure it is blocked before we notify
+    if (m_waiters) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+        }
+        m_cv.notify_all();
+    }
+}
+
+bool SequenceSignal::WaitPast(uint64_t sequence, int timeoutMs)
+{
+    if (m_sequence > sequence)
+        return true;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_waiters++;
+    bool result = m_cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&]{ return m_sequence > sequence; });
+    m_waiters--;
+    return result;
+}
@@ -0,0 +1,28 @@
+#ifndef SEQUENCESIGNAL_H
+#define SEQUENCESIGNAL_H
+
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+
+// counter that one thread increments and any number of threads can wait on. Signal only
+// touches the mutex when somebody waits, so it costs two atomics on the signalling thread
+class SequenceSignal
+{
+public:
+    uint64_t Get() const { return m_sequence; }
+
+    void Signal();
+    // waits until the counter is greater than sequence. false on timeout
+    bool WaitPast(uint64_t sequence, int timeoutMs);
+
+private:
+    std::atomic<uint64_t> m_sequence{0};
+    std::atomic<int> m_waiters{0};
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+};
+
+#endif
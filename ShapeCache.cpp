@@ -0,0 +1,118 @@
+#include "ShapeCache.h"
+
+#include <vector>
+#include <cmath>
+
+
+// ring width in 64ths of the radius, arc and cone angles in whole degrees
+static const int RING_STEPS = 64;
+
+static int QuantizeParam(ShapeType type, float param)
+{
+    int q = 0;
+    switch (type)
+    {
+    case SHAPE_RING:
+        q = static_cast<int>(param * RING_STEPS + 0.5f);
+        return q < 0 ? 0 : q > RING_STEPS - 1 ? RING_STEPS - 1 : q;
+    case SHAPE_ARC:
+    case SHAPE_CONE:
+        q = static_cast<int>(D3DXToDegree(param) + 0.5f);
+        return q < 1 ? 1 : q > 360 ? 360 : q;
+    default:
+        return 0;
+    }
+}
+
+
+int ShapeCache::SelectLod(float screenRadius)
+{
+    if (screenRadius <= 0.5f)
+        return 0;
+
+    // a chord of a circle with radius r deviates r * (1 - cos(a / 2)) from it
+    float segments = D3DX_PI / acos(1.0f - 0.5f / screenRadius);
+    for (int lod = 0; lod < LOD_COUNT; lod++) {
+        if (GetSegments(lod) >= segments)
+            return lod;
+    }
+    return LOD_COUNT - 1;
+}
+
+D3DPRIMITIVETYPE ShapeCache::GetPrimitiveType(ShapeType type)
+{
+    switch (type)
+    {
+    case SHAPE_DISC:
+    case SHAPE_CONE:
+        return D3DPT_TRIANGLEFAN;
+    case SHAPE_RING:
+        return D3DPT_TRIANGLESTRIP;
+    default:
+        return D3DPT_LINESTRIP;
+    }
+}
+
+bool ShapeCache::Prebuild(hl::Drawer *pDrawer)
+{
+    for (int lod = 0; lod < LOD_COUNT; lod++) {
+        if (!Get(pDrawer, SHAPE_CIRCLE, lod, 0) || !Get(pDrawer, SHAPE_DISC, lod, 0))
+            return false;
+    }
+    return true;
+}
+
+const hl::VertexBuffer *ShapeCache::Get(hl::Drawer *pDrawer, ShapeType type, int lod, float param)
+{
+    int q = QuantizeParam(type, param);
+    uint32_t key = static_cast<uint32_t>(type) << 24 | static_cast<uint32_t>(lod) << 16 | static_cast<uint32_t>(q);
+
+    auto it = m_buffers.find(key);
+    if (it != m_buffers.end())
+        return it->second;
+
+    const hl::VertexBuffer *vb = Build(pDrawer, type, lod, q);
+    // failed allocations are not cached, the next frame tries again
+    if (vb)
+        m_buffers[key] = vb;
+    return vb;
+}
+
+const hl::VertexBuffer *ShapeCache::Build(hl::Drawer *pDrawer, ShapeType type, int lod, int param)
+{
+    int segments = GetSegments(lod);
+    float start = 0;
+    float angle = 2*D3DX_PI;
+    if (type == SHAPE_ARC || type == SHAPE_CONE) {
+        angle = D3DXToRadian(static_cast<float>(param));
+        start = -angle / 2;
+        segments = static_cast<int>(ceil(segments * angle / (2*D3DX_PI)));
+        if (segments < 1)
+            segments = 1;
+    }
+
+    std::vector<hl::VERTEX_3D_COL> verts;
+    auto addVertex = [&](float x, float y) {
+        hl::VERTEX_3D_COL v = {};
+        v.x = x;
+        v.y = y;
+        v.z = 0;
+        verts.push_back(v);
+    };
+
+    if (type == SHAPE_DISC || type == SHAPE_CONE)
+        addVertex(0, 0);
+
+    // angle descending like the baseline circle, so filled shapes keep the winding the game's
+    // cull state expects. the ring puts the inner vertex first for the same winding
+    float inner = static_cast<float>(param) / RING_STEPS;
+    for (int i = 0; i <= segments; i++)
+    {
+        float a = start + angle * (segments - i) / segments;
+        if (type == SHAPE_RING)
+            addVertex(inner * cos(a), inner * sin(a));
+        addVertex(cos(a), sin(a));
+    }
+
+    return pDrawer->AllocVertexBuffer(verts);
+}
@@ -0,0 +1,48 @@
+#ifndef SHAPECACHE_H
+#define SHAPECACHE_H
+
+#include "hacklib/Drawer.h"
+
+#include "d3dx9.h"
+#include <unordered_map>
+#include <cstdint>
+
+
+enum ShapeType : uint8_t
+{
+    SHAPE_CIRCLE,
+    SHAPE_DISC,
+    // band between the unit circle and param times its radius
+    SHAPE_RING,
+    // part of the circle param radians wide, centered on the x-axis
+    SHAPE_ARC,
+    // filled sector param radians wide, centered on the x-axis
+    SHAPE_CONE
+};
+
+// unit shapes on the xy-plane at several tessellation levels, allocated on first use. params are
+// quantized so a handful of buffers serves all sizes. not thread safe, used by the render thread
+// and by InitEsp before anything is drawn
+class ShapeCache
+{
+public:
+    static const int LOD_COUNT = 5;
+
+    // segments of a full circle at each level
+    static int GetSegments(int lod) { return 12 << lod; }
+    // lowest level that keeps the outline within half a pixel of a true circle
+    static int SelectLod(float screenRadius);
+    static D3DPRIMITIVETYPE GetPrimitiveType(ShapeType type);
+
+    // allocates the circles and discs of all levels
+    bool Prebuild(hl::Drawer *pDrawer);
+    // nullptr if the buffer could not be allocated
+    const hl::VertexBuffer *Get(hl::Drawer *pDrawer, ShapeType type, int lod, float param);
+
+private:
+    const hl::VertexBuffer *Build(hl::Drawer *pDrawer, ShapeType type, int lod, int param);
+
+    std::unordered_map<uint32_t, const hl::VertexBuffer*> m_buffers;
+};
+
+#endif
@@ -0,0 +1,272 @@
+#ifndef SHAREDSNAPSHOT_H
+#define SHAREDSNAPSHOT_H
+
+// binary layout of the snapshots gw2lib exports to shared memory, and a reader for other
+// processes. this header has no dependencies on the rest of gw2lib so it can be copied into
+// other projects. it builds on windows (named file mapping) and posix (shm_open).
+//
+// the mapping holds a Header followed by SLOT_COUNT slots. the writer fills the slots in turn
+// and marks a slot as being written with an odd sequence number. a reader looks up the newest
+// slot, uses it in place and afterwards checks that the sequence did not change. with
+// SLOT_COUNT slots a reader has SLOT_COUNT-1 ticks before the slot it uses is overwritten.
+
+#include <atomic>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+namespace SharedSnapshot
+{
+    static const uint32_t MAGIC = 0x32574753; // "SGW2"
+    static const uint32_t VERSION = 1;
+    static const uint32_t SLOT_COUNT = 4;
+    static const uint32_t MAX_AGENTS = 8192;
+    static const uint32_t MAX_CHARACTERS = 4096;
+    static const uint32_t NAME_SIZE = 64;
+    static const char *const DEFAULT_NAME = "gw2lib_snapshot";
+
+    enum CharacterFlags : uint32_t
+    {
+        CHARACTER_ALIVE = 1 << 0,
+        CHARACTER_DOWNED = 1 << 1,
+        CHARACTER_CONTROLLED = 1 << 2,
+        CHARACTER_PLAYER = 1 << 3,
+        CHARACTER_IN_WATER = 1 << 4,
+        CHARACTER_MONSTER = 1 << 5,
+        CHARACTER_MONSTER_PLAYER_CLONE = 1 << 6,
+    };
+
+    // numeric values of the enums are the ones of GW2LIB::GW2
+    struct Agent
+    {
+        int32_t agentId;
+        int32_t category;
+        int32_t type;
+        float x, y, z;
+        float rot;
+        int32_t staleTicks;
+    };
+
+    struct Character
+    {
+        int32_t agentId;
+        uint32_t flags;
+        int32_t level;
+        int32_t scaledLevel;
+        int32_t profession;
+        int32_t attitude;
+        int32_t wvwSupply;
+        int32_t breakbarState;
+        float currentHealth;
+        float maxHealth;
+        float currentEndurance;
+        float maxEndurance;
+        float breakbarPercent;
+        float gliderPercent;
+        int32_t staleTicks;
+        uint32_t reserved;
+        // utf-8, zero terminated, empty for non-players
+        char name[NAME_SIZE];
+    };
+
+    struct Slot
+    {
+        // odd while the writer is in this slot, 2*(publish count) once it is complete
+        std::atomic<uint64_t> sequence;
+        uint64_t tick;
+        int32_t mapId;
+        int32_t ping;
+        int32_t fps;
+        // agent ids, -1 if there is none
+        int32_t ownAgentId;
+        int32_t autoSelectionAgentId;
+        int32_t hoverSelectionAgentId;
+        int32_t lockedSelectionAgentId;
+        uint32_t camValid;
+        float camPos[3];
+        float camViewVec[3];
+        float fovy;
+        uint32_t agentCount;
+        uint32_t characterCount;
+        uint32_t reserved[3];
+        Agent agents[MAX_AGENTS];
+        Character characters[MAX_CHARACTERS];
+    };
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t slotCount;
+        uint32_t slotSize;
+        // publish count of the newest complete slot, which is slots[latest % SLOT_COUNT].
+        // 0 means nothing was published yet
+        std::atomic<uint64_t> latest;
+        uint64_t reserved[5];
+    };
+
+    struct Mapping
+    {
+        Header header;
+        Slot slots[SLOT_COUNT];
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be lock-free");
+    static_assert(sizeof(Agent) == 32, "layout changed, bump VERSION");
+    static_assert(sizeof(Character) == 128, "layout changed, bump VERSION");
+    static_assert(sizeof(Header) == 64, "layout changed, bump VERSION");
+    static_assert(offsetof(Slot, agents) == 96, "layout changed, bump VERSION");
+
+
+    // maps the named shared memory of a size of sizeof(Mapping). the writer creates it
+    class SharedMemory
+    {
+    public:
+        ~SharedMemory() { Close(); }
+
+        bool Open(const char *name, bool bCreate)
+        {
+            Close();
+#ifdef _WIN32
+            if (bCreate)
+                m_handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(sizeof(Mapping)), name);
+            else
+                m_handle = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+            if (!m_handle)
+                return false;
+            m_pMapping = static_cast<Mapping*>(MapViewOfFile(m_handle, bCreate ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, sizeof(Mapping)));
+#else
+            m_name = std::string("/") + name;
+            m_bOwner = bCreate;
+            int fd = shm_open(m_name.c_str(), bCreate ? O_CREAT | O_RDWR : O_RDONLY, 0644);
+            if (fd < 0)
+                return false;
+            if (bCreate && ftruncate(fd, sizeof(Mapping)) != 0) {
+                close(fd);
+                return false;
+            }
+            void *p = mmap(nullptr, sizeof(Mapping), bCreate ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            m_pMapping = p == MAP_FAILED ? nullptr : static_cast<Mapping*>(p);
+#endif
+            if (!m_pMapping) {
+                Close();
+                return false;
+            }
+            return true;
+        }
+
+        void Close()
+        {
+#ifdef _WIN32
+            if (m_pMapping)
+                UnmapViewOfFile(m_pMapping);
+            if (m_handle)
+                CloseHandle(m_handle);
+            m_handle = nullptr;
+#else
+            if (m_pMapping)
+                munmap(m_pMapping, sizeof(Mapping));
+            if (m_bOwner && !m_name.empty())
+                shm_unlink(m_name.c_str());
+            m_name.clear();
+            m_bOwner = false;
+#endif
+            m_pMapping = nullptr;
+        }
+
+        Mapping *Get() const { return m_pMapping; }
+
+    private:
+        Mapping *m_pMapping = nullptr;
+#ifdef _WIN32
+        HANDLE m_handle = nullptr;
+#else
+        std::string m_name;
+        bool m_bOwner = false;
+#endif
+    };
+
+
+    // usage:
+    //   SharedSnapshot::Reader reader;
+    //   reader.Open();
+    //   const Slot *pSlot;
+    //   uint64_t seq;
+    //   if (reader.Acquire(pSlot, seq)) {
+    //       ... read pSlot in place ...
+    //       if (reader.Validate(pSlot, seq)) { the data was consistent }
+    //   }
+    class Reader
+    {
+    public:
+        bool Open(const char *name = DEFAULT_NAME)
+        {
+            if (!m_memory.Open(name, false))
+                return false;
+            const Header &header = m_memory.Get()->header;
+            if (header.magic != MAGIC || header.version != VERSION || header.slotSize != sizeof(Slot)) {
+                m_memory.Close();
+                return false;
+            }
+            return true;
+        }
+
+        void Close() { m_memory.Close(); }
+
+        // newest complete slot. false if nothing is published or the writer is lapping us
+        bool Acquire(const Slot *&pSlot, uint64_t &sequence) const
+        {
+            const Mapping *pMapping = m_memory.Get();
+            if (!pMapping)
+                return false;
+            uint64_t latest = pMapping->header.latest.load(std::memory_order_acquire);
+            if (!latest)
+                return false;
+            pSlot = &pMapping->slots[latest % SLOT_COUNT];
+            sequence = pSlot->sequence.load(std::memory_order_acquire);
+            return sequence == 2*latest;
+        }
+
+        // true if the slot was not touched by the writer since Acquire
+        bool Validate(const Slot *pSlot, uint64_t sequence) const
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return pSlot->sequence.load(std::memory_order_relaxed) == sequence;
+        }
+
+        // copies the newest complete slot, retrying while the writer is in the way
+        bool Copy(Slot &out, int maxTries = 4) const
+        {
+            for (int i = 0; i < maxTries; i++)
+            {
+                const Slot *pSlot;
+                uint64_t sequence;
+                if (!Acquire(pSlot, sequence))
+                    continue;
+                memcpy(static_cast<void*>(&out), pSlot, sizeof(Slot));
+                if (Validate(pSlot, sequence))
+                    return true;
+            }
+            return false;
+        }
+
+        uint64_t GetLatest() const { return m_memory.Get() ? m_memory.Get()->header.latest.load(std::memory_order_acquire) : 0; }
+
+    private:
+        SharedMemory m_memory;
+    };
+}
+
+#endif
@@ -0,0 +1,134 @@
+#include "SnapshotExport.h"
+
+
+static int32_t AgentIdOf(const GameData::AgentData *pAgentData)
+{
+    return pAgentData ? pAgentData->agentId : -1;
+}
+
+
+bool GameData::SnapshotExport::Open(const char *name)
+{
+    if (!m_memory.Open(name, true))
+        return false;
+
+    SharedSnapshot::Mapping *pMapping = m_memory.Get();
+    pMapping->header.latest.store(0, std::memory_order_relaxed);
+    for (auto& slot : pMapping->slots)
+        slot.sequence.store(0, std::memory_order_relaxed);
+    pMapping->header.slotCount = SharedSnapshot::SLOT_COUNT;
+    pMapping->header.slotSize = sizeof(SharedSnapshot::Slot);
+    pMapping->header.version = SharedSnapshot::VERSION;
+    // readers check the magic last
+    std::atomic_thread_fence(std::memory_order_release);
+    pMapping->header.magic = SharedSnapshot::MAGIC;
+
+    m_published = 0;
+    return true;
+}
+
+void GameData::SnapshotExport::Close()
+{
+    m_memory.Close();
+}
+
+void GameData::SnapshotExport::Publish(const GameData &gameData, uint64_t tick)
+{
+    using namespace SharedSnapshot;
+
+    Mapping *pMapping = m_memory.Get();
+    if (!pMapping)
+        return;
+
+    const auto& objData = gameData.objData;
+
+    uint64_t n = ++m_published;
+    Slot &slot = pMapping->slots[n % SLOT_COUNT];
+    slot.sequence.store(2*n - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.tick = tick;
+    slot.mapId = gameData.mapId;
+    slot.ping = gameData.ping;
+    slot.fps = gameData.fps;
+    slot.ownAgentId = AgentIdOf(objData.ownAgent);
+    slot.autoSelectionAgentId = AgentIdOf(objData.autoSelection);
+    slot.hoverSelectionAgentId = AgentIdOf(objData.hoverSelection);
+    slot.lockedSelectionAgentId = AgentIdOf(objData.lockedSelection);
+    slot.camValid = gameData.camData.valid;
+    slot.camPos[0] = gameData.camData.camPos.x;
+    slot.camPos[1] = gameData.camData.camPos.y;
+    slot.camPos[2] = gameData.camData.camPos.z;
+    slot.camViewVec[0] = gameData.camData.viewVec.x;
+    slot.camViewVec[1] = gameData.camData.viewVec.y;
+    slot.camViewVec[2] = gameData.camData.viewVec.z;
+    slot.fovy = gameData.camData.fovy;
+
+    uint32_t nAgents = 0;
+    for (const auto& pAgentData : objData.agentDataList)
+    {
+        if (!pAgentData || !pAgentData->hasData)
+            continue;
+        if (nAgents == MAX_AGENTS)
+            break;
+
+        Agent &agent = slot.agents[nAgents++];
+        agent.agentId = pAgentData->agentId;
+        agent.category = pAgentData->category;
+        agent.type = pAgentData->type;
+        agent.x = pAgentData->pos.x;
+        agent.y = pAgentData->pos.y;
+        agent.z = pAgentData->pos.z;
+        agent.rot = pAgentData->rot;
+        agent.staleTicks = pAgentData->staleTicks;
+    }
+    slot.agentCount = nAgents;
+
+    uint32_t nChars = 0;
+    for (const auto& pCharData : objData.charDataList)
+    {
+        if (!pCharData->hasData)
+            continue;
+        if (nChars == MAX_CHARACTERS)
+            break;
+
+        Character &chr = slot.characters[nChars++];
+        chr.agentId = pCharData->agentId;
+        chr.flags = (pCharData->isAlive ? CHARACTER_ALIVE : 0) |
+            (pCharData->isDowned ? CHARACTER_DOWNED : 0) |
+            (pCharData->isControlled ? CHARACTER_CONTROLLED : 0) |
+            (pCharData->isPlayer ? CHARACTER_PLAYER : 0) |
+            (pCharData->isInWater ? CHARACTER_IN_WATER : 0) |
+            (pCharData->isMonster ? CHARACTER_MONSTER : 0) |
+            (pCharData->isMonsterPlayerClone ? CHARACTER_MONSTER_PLAYER_CLONE : 0);
+        chr.level = pCharData->level;
+        chr.scaledLevel = pCharData->scaledLevel;
+        chr.profession = pCharData->profession;
+        chr.attitude = pCharData->attitude;
+        chr.wvwSupply = pCharData->wvwsupply;
+        chr.breakbarState = pCharData->breakbarState;
+        chr.currentHealth = pCharData->currentHealth;
+        chr.maxHealth = pCharData->maxHealth;
+        chr.currentEndurance = pCharData->currentEndurance;
+        chr.maxEndurance = pCharData->maxEndurance;
+        chr.breakbarPercent = pCharData->breakbarPercent;
+        chr.gliderPercent = pCharData->gliderPercent;
+        chr.staleTicks = pCharData->staleTicks;
+        chr.reserved = 0;
+
+        size_t len = 0;
+        if (pCharData->pPlayerData) {
+            std::string_view name = pCharData->pPlayerData->name;
+            len = name.size() < NAME_SIZE ? name.size() : NAME_SIZE - 1;
+            // do not cut a multi byte sequence in half
+            while (len < name.size() && len && (name[len] & 0xc0) == 0x80)
+                len--;
+            memcpy(chr.name, name.data(), len);
+        }
+        chr.name[len] = 0;
+    }
+    slot.characterCount = nChars;
+
+    slot.sequence.store(2*n, std::memory_order_release);
+    pMapping->header.latest.store(n, std::memory_order_release);
+}
@@ -0,0 +1,27 @@
+#ifndef SNAPSHOTEXPORT_H
+#define SNAPSHOTEXPORT_H
+
+#include "GameData.h"
+#include "SharedSnapshot.h"
+
+
+namespace GameData
+{
+    // writes decoded ticks into the shared memory of SharedSnapshot.h. runs on the ingest
+    // thread right after decoding, the game thread does not see any of this
+    class SnapshotExport
+    {
+    public:
+        bool Open(const char *name);
+        void Close();
+        bool IsOpen() const { return m_memory.Get() != nullptr; }
+
+        void Publish(const GameData &gameData, uint64_t tick);
+
+    private:
+        SharedSnapshot::SharedMemory m_memory;
+        uint64_t m_published = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,121 @@
+#include "TaskScheduler.h"
+#include "AsyncLog.h"
+
+
+// no objects with destructors may live here because of __try
+static bool ResumeGuarded(std::coroutine_handle<> handle)
+{
+    __try {
+        handle.resume();
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        return false;
+    }
+    return true;
+}
+
+
+TaskScheduler::TaskScheduler()
+{
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    m_freq = freq.QuadPart;
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    for (auto handle : m_added)
+        handle.destroy();
+    for (auto handle : m_ready)
+        handle.destroy();
+    for (auto handle : m_nextFrame)
+        handle.destroy();
+    for (auto handle : m_nextTick)
+        handle.destroy();
+}
+
+void TaskScheduler::Add(Handle handle)
+{
+    std::lock_guard<std::mutex> lock(m_addMutex);
+    m_added.push_back(handle);
+}
+
+void TaskScheduler::SetFrameBudget(float microseconds)
+{
+    std::lock_guard<std::mutex> lock(m_addMutex);
+    m_frameBudget = microseconds;
+}
+
+void TaskScheduler::RunFrame(uint64_t tickSequence)
+{
+    float frameBudget;
+    {
+        std::lock_guard<std::mutex> lock(m_addMutex);
+        for (auto handle : m_added)
+            m_ready.push_back(handle);
+        m_added.clear();
+        frameBudget = m_frameBudget;
+    }
+
+    for (auto handle : m_nextFrame)
+        m_ready.push_back(handle);
+    m_nextFrame.clear();
+
+    if (tickSequence != m_lastTick) {
+        m_lastTick = tickSequence;
+        for (auto handle : m_nextTick)
+            m_ready.push_back(handle);
+        m_nextTick.clear();
+    }
+
+    if (m_ready.empty())
+        return;
+
+    m_frameDeadline = Now() + static_cast<int64_t>(frameBudget * m_freq / 1000000.0f);
+
+    // tasks that gave up their slice go to the back, whatever is left over starts the next frame
+    while (!m_ready.empty() && Now() < m_frameDeadline)
+    {
+        Handle handle = m_ready.front();
+        m_ready.pop_front();
+
+        handle.promise().wait = GW2LIB::Task::promise_type::WAIT_NONE;
+        m_sliceStart = Now();
+
+        if (!ResumeGuarded(handle)) {
+            // the coroutine frame is in an unknown state after this, drop it without destroying
+            ASYNC_LOG_ERR("[TaskScheduler] Exception in task, task dropped\n");
+            continue;
+        }
+
+        if (handle.done()) {
+            handle.destroy();
+            continue;
+        }
+
+        switch (handle.promise().wait)
+        {
+        case GW2LIB::Task::promise_type::WAIT_FRAME:
+            m_nextFrame.push_back(handle);
+            break;
+        case GW2LIB::Task::promise_type::WAIT_TICK:
+            m_nextTick.push_back(handle);
+            break;
+        default:
+            m_ready.push_back(handle);
+            break;
+        }
+    }
+}
+
+bool TaskScheduler::IsSliceExpired(float microseconds) const
+{
+    int64_t now = Now();
+    return now >= m_frameDeadline || (now - m_sliceStart) * 1000000.0f / m_freq >= microseconds;
+}
+
+int64_t TaskScheduler::Now() const
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
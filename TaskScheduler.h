@@ -0,0 +1,49 @@
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include "gw2lib.h"
+
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <cstdint>
+
+
+// resumes GW2LIB::Task coroutines on the render thread. every task waits in exactly one of
+// the lists, RunFrame moves them around according to what they awaited
+class TaskScheduler
+{
+public:
+    typedef std::coroutine_handle<GW2LIB::Task::promise_type> Handle;
+
+    TaskScheduler();
+    ~TaskScheduler();
+
+    // any thread
+    void Add(Handle handle);
+    void SetFrameBudget(float microseconds);
+
+    // render thread
+    void RunFrame(uint64_t tickSequence);
+    bool IsSliceExpired(float microseconds) const;
+
+    size_t GetTaskCount() const { return m_ready.size() + m_nextFrame.size() + m_nextTick.size(); }
+
+private:
+    int64_t Now() const;
+
+    std::mutex m_addMutex;
+    std::vector<Handle> m_added;
+    float m_frameBudget = 1000.0f;
+
+    std::deque<Handle> m_ready;
+    std::vector<Handle> m_nextFrame;
+    std::vector<Handle> m_nextTick;
+    uint64_t m_lastTick = 0;
+
+    int64_t m_freq = 0;
+    int64_t m_frameDeadline = 0;
+    int64_t m_sliceStart = 0;
+};
+
+#endif
@@ -11,14 +11,18 @@ http://www.gamerevision.com/showthread.php?3691-Gw2lib&p=45709
 
 #include <Windows.h>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <utility>
+#include <chrono>
+#include <coroutine>
 #include <cstdint>
 
 struct PrimitiveDiffuseMesh;
 namespace GameData {
     struct CharacterData;
     struct AgentData;
+    struct Snapshot;
 }
 
 namespace GW2LIB
@@ -76,6 +80,14 @@ namespace GW2LIB
         };
     }
 
+    // how much of an agent the esp should draw, see SetEspBudget
+    enum EspLod {
+        ESP_LOD_FULL = 0,   // everything, e.g. circles, direction and labels
+        ESP_LOD_REDUCED,    // shapes without labels
+        ESP_LOD_DOT,        // a single dot
+        ESP_LOD_HIDDEN      // off screen or out of budget
+    };
+
     //////////////////////////////////////////////////////////////////////////
     // # general functions
     //////////////////////////////////////////////////////////////////////////
@@ -83,6 +95,10 @@ namespace GW2LIB
     // registers a callback to be used for a custom esp
     // use draw functions inside the callback function
     void EnableEsp(void (*)());
+    // calls the esp callback only hz times per second and records what it draws. the recording
+    // is drawn every frame, projected functions and Font::DrawProjected follow the current
+    // camera while screen space drawing stays where it was recorded. 0 calls it every frame
+    void SetEspRecordRate(float hz);
 
 
     //////////////////////////////////////////////////////////////////////////
@@ -110,6 +126,23 @@ namespace GW2LIB
         Vector3 GetPos() const;
         float GetRot() const;
 
+        // number of ticks since the data was last read from the game, see SetRefreshBudget
+        int GetStaleTicks() const;
+        // agent did not move for a while and is only refreshed on a long interval
+        bool IsStatic() const;
+
+        // derived once per tick on worker threads
+        // distance to the own agent, 0 if there is none
+        float GetDistanceToSelf() const;
+        // 0 for anything that is not a living hostile character close by, higher is more dangerous
+        float GetThreat() const;
+        // screen position with the camera of the tick, false if it is off screen
+        bool GetScreenPos(float *outX, float *outY) const;
+        // living characters close to each other share an id, -1 for everything else
+        int GetClusterId() const;
+        // level of detail assigned by importance and the esp budget
+        EspLod GetEspLod() const;
+
         GameData::AgentData *m_ptr;
         size_t iterator = 0;
     };
@@ -152,6 +185,11 @@ namespace GW2LIB
         GW2::Attitude GetAttitude() const;
 
         std::string GetName() const;
+        // utf-8 name without a copy, stays valid as long as the library is loaded
+        std::string_view GetNameView() const;
+
+        // number of ticks since the data was last read from the game, see SetRefreshBudget
+        int GetStaleTicks() const;
     
         GameData::CharacterData *m_ptr;
     };
@@ -173,11 +211,270 @@ namespace GW2LIB
     int GetPing();
     int GetFPS();
 
+    // limits the work done inside the game thread per tick. the own character, the selected
+    // agents and hostiles within priorityRange of the own agent are refreshed on every tick,
+    // everything else is refreshed round-robin. a value of 0 means no limit
+    void SetRefreshBudget(int maxEntities, float maxMicroseconds, float priorityRange = 2000.0f);
+    // sub-objects that are read separately, a fault in one of them only drops that field
+    enum CaptureField {
+        CAPTURE_FIELD_TRANSFORM,
+        CAPTURE_FIELD_CHARACTER,
+        CAPTURE_FIELD_HEALTH,
+        CAPTURE_FIELD_ENDURANCE,
+        CAPTURE_FIELD_CORESTATS,
+        CAPTURE_FIELD_INVENTORY,
+        CAPTURE_FIELD_BREAKBAR,
+        CAPTURE_FIELD_PLAYERNAME,
+        CAPTURE_FIELD_COUNT
+    };
+    struct RefreshStats {
+        int budgetEntities;
+        float budgetMicroseconds;
+        int entitiesTotal;
+        int entitiesRefreshed;
+        // entitiesRefreshed / entitiesTotal of the last tick
+        float coverage;
+        int maxStaleTicks;
+        // time spent in the game thread during the last tick
+        float captureMicroseconds;
+        // agent array slots that hold a different agent than on the tick before
+        int agentSlotsChanged;
+        // vcalls not done compared to resolving the agent array twice
+        int vcallsSaved;
+        // game objects that faulted during the last tick and are skipped for a while, reads skipped
+        // because of that, and sub-objects that were unreadable or faulted, indexed by CaptureField
+        int objectFaults;
+        int quarantined;
+        int fieldFaults[CAPTURE_FIELD_COUNT];
+        // pointer checks that were not answered by the page cache
+        int pageCacheMisses;
+        // true while offsets from SetMems are used instead of the compiled in defaults
+        bool runtimeMems;
+        // moving average of captureMicroseconds for either path, to compare both
+        float avgCaptureMicrosecondsStatic;
+        float avgCaptureMicrosecondsRuntime;
+    };
+    RefreshStats GetRefreshStats();
+
+    // consistent view of the game data for threads other than the esp callback, e.g. gw2lib_main
+    // or your own workers. while a Snapshot is alive, every function called on the same thread
+    // reads from it, so Agent and Character objects must not outlive it. any number of threads
+    // can hold snapshots, the library never waits for them. while readers hold every buffered
+    // snapshot, new readers get the newest of those. snapshots are made every tick once this was
+    // called for the first time
+    class Snapshot {
+    public:
+        ~Snapshot();
+        Snapshot(const Snapshot &) = delete;
+        Snapshot &operator= (const Snapshot &) = delete;
+
+        // false if no data was available
+        bool IsValid() const { return m_ptr != nullptr; }
+        uint64_t GetTick() const;
+
+    private:
+        friend Snapshot AcquireSnapshot();
+        Snapshot(GameData::Snapshot *pSnapshot, GameData::Snapshot *pPrevious);
+
+        GameData::Snapshot *m_ptr;
+        GameData::Snapshot *m_pPrevious;
+    };
+    // auto snapshot = GW2LIB::AcquireSnapshot();
+    Snapshot AcquireSnapshot();
+
+    // block until the data of a newer game tick is available or a frame was presented, instead
+    // of polling with sleeps. return false on timeout
+    bool WaitForNextTick(int timeoutMs = 100);
+    bool WaitForFrame(int timeoutMs = 100);
+    // number of game ticks decoded so far
+    uint64_t GetTickSequence();
+
+    // per tick analytics on the worker pool, like the built-in Agent::GetThreat. after every
+    // decode, run is called on the worker threads for consecutive ranges [begin, end) of agent
+    // slots, then finish is called once on the ingest thread. jobs run in registration order
+    // after the built-in ones have finished, and the tick only reaches the esp and snapshots after
+    // all of them.
+    // - the getters read the tick being derived in both functions, including the derived values
+    //   like GetThreat and GetClusterId. GetAgentBySlot gives the agent of a slot
+    // - run is called concurrently for different ranges and together with the run of the other
+    //   registered jobs. it may read any agent through the getters, but only write your own state
+    //   of the slots in its range and only read that state for its range. finish runs alone and
+    //   can combine the results
+    // - neither may draw, acquire a snapshot or wait for a tick. keep both short, decoding of the
+    //   next tick waits for them
+    // can be called from any thread, the job starts with the next tick. name must stay valid, use
+    // a literal. run or finish may be nullptr
+    void RegisterDerivedJob(const char *name, void (*run)(size_t begin, size_t end), void (*finish)() = nullptr);
+    // agent slots of the current tick and the agent in a slot, invalid for an empty slot
+    size_t GetAgentSlotCount();
+    Agent GetAgentBySlot(size_t slot);
+
+    // looks up the agent of a game Agent::CAgentBase* or CharClient::CCharacter* in a hash map
+    Agent FindAgentByGamePointer(void *pAgent);
+    Character FindCharacterByGamePointer(void *pCharacter);
+
+    // static agents like keyframed objects and gadgets near pos, without iterating all agents
+    std::vector<Agent> GetStaticAgentsInRange(Vector3 pos, float range);
+
+    // player characters by utf-8 name through the interned name index, without iterating all characters
+    Character FindCharacterByName(std::string_view name, bool ignoreCase = false);
+    std::vector<Character> FindCharactersByNamePrefix(std::string_view prefix, bool ignoreCase = true);
+
+    // publishes every decoded tick to named shared memory for other processes, see SharedSnapshot.h
+    // for the layout and a reader. name defaults to SharedSnapshot::DEFAULT_NAME
+    bool EnableSnapshotExport(const char *name = nullptr);
+    void DisableSnapshotExport();
+
+
+    //////////////////////////////////////////////////////////////////////////
+    // # queries
+    //////////////////////////////////////////////////////////////////////////
+    // boolean character properties that are packed into per tick bitsets
+    enum CharacterFlag {
+        CHAR_FLAG_ALIVE = 0,
+        CHAR_FLAG_DOWNED,
+        CHAR_FLAG_CONTROLLED,
+        CHAR_FLAG_PLAYER,
+        CHAR_FLAG_IN_WATER,
+        CHAR_FLAG_MONSTER,
+        CHAR_FLAG_MONSTER_PLAYER_CLONE,
+        CHAR_FLAG_FRIENDLY,
+        CHAR_FLAG_HOSTILE,
+        CHAR_FLAG_INDIFFERENT,
+        CHAR_FLAG_NEUTRAL,
+        CHAR_FLAG_HAS_AGENT,
+        CHAR_FLAG_COUNT
+    };
+
+    // filter over all characters of the current tick
+    // predicates are combined with AND, Or() starts a new alternative
+    // alternatives without predicates are ignored, a query without any predicate matches every character
+    // example: CharacterQuery().Is(CHAR_FLAG_PLAYER).Is(CHAR_FLAG_HOSTILE).LevelAtLeast(80).WithinDistance(mypos, 1500).Execute()
+    class CharacterQuery {
+    public:
+        CharacterQuery &Is(CharacterFlag flag);
+        CharacterQuery &IsNot(CharacterFlag flag);
+        CharacterQuery &LevelAtLeast(int level);
+        CharacterQuery &LevelAtMost(int level);
+        CharacterQuery &ProfessionIs(GW2::Profession profession);
+        CharacterQuery &WithinDistance(Vector3 pos, float range);
+        CharacterQuery &Or();
+
+        // indices into the character list of the current tick
+        std::vector<size_t> ExecuteIndices() const;
+        std::vector<Character> Execute() const;
+        size_t Count() const;
+
+    private:
+        enum PredicateType {
+            PRED_FLAG,
+            PRED_NOT_FLAG,
+            PRED_LEVEL_MIN,
+            PRED_LEVEL_MAX,
+            PRED_PROFESSION,
+            PRED_DISTANCE
+        };
+        struct Predicate {
+            PredicateType type;
+            int flagOrValue;
+            Vector3 pos;
+            float range;
+        };
+        void Add(const Predicate &pred);
+        std::vector<std::vector<Predicate>> m_groups;
+    };
+
+
+    //////////////////////////////////////////////////////////////////////////
+    // # tasks
+    //////////////////////////////////////////////////////////////////////////
+    // coroutines that are resumed on the render thread after the esp callback, until the
+    // per frame task budget is spent. they can use everything the esp callback can, including
+    // the draw functions. long work is sliced across frames like this:
+    //
+    // GW2LIB::Task SortCharacters()
+    // {
+    //     for (...) {
+    //         ...
+    //         co_await GW2LIB::Budget(0.5ms); // gives up the frame after 0.5ms of work
+    //     }
+    //     co_await GW2LIB::NextTick();
+    // }
+    // GW2LIB::StartTask(SortCharacters());
+
+    class Task {
+    public:
+        struct promise_type {
+            enum Wait { WAIT_NONE, WAIT_FRAME, WAIT_TICK };
+            Wait wait = WAIT_NONE;
+
+            Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() { }
+            void unhandled_exception();
+        };
+
+        Task(Task &&other) noexcept : m_handle(other.m_handle) { other.m_handle = nullptr; }
+        Task(const Task &) = delete;
+        Task &operator= (const Task &) = delete;
+        ~Task() { if (m_handle) m_handle.destroy(); }
+
+    private:
+        friend void StartTask(Task task);
+        explicit Task(std::coroutine_handle<promise_type> handle) : m_handle(handle) { }
+        std::coroutine_handle<promise_type> m_handle;
+    };
+
+    // the scheduler takes over the task, it is first resumed in the next frame. can be called from any thread
+    void StartTask(Task task);
+    // time all tasks together may take per frame, 1000 by default
+    void SetTaskFrameBudget(float microseconds);
+    // true if the running task was resumed more than microseconds ago or the frame budget is spent
+    bool IsTaskSliceExpired(float microseconds);
+
+    struct NextFrame {
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<Task::promise_type> h) const noexcept { h.promise().wait = Task::promise_type::WAIT_FRAME; }
+        void await_resume() const noexcept { }
+    };
+
+    // resumes once the data of a newer game tick was decoded
+    struct NextTick {
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<Task::promise_type> h) const noexcept { h.promise().wait = Task::promise_type::WAIT_TICK; }
+        void await_resume() const noexcept { }
+    };
+
+    // continues right away while the task is within its slice, otherwise lets other tasks run.
+    // the task is resumed later in the frame if there is budget left or else in the next one.
+    // the slice is in microseconds like the other task functions, or any std::chrono duration
+    struct Budget {
+        explicit Budget(float microseconds) : microseconds(microseconds) { }
+        template <typename Rep, typename Period>
+        Budget(std::chrono::duration<Rep, Period> slice) : microseconds(std::chrono::duration<float, std::micro>(slice).count()) { }
+
+        bool await_ready() const noexcept { return !IsTaskSliceExpired(microseconds); }
+        void await_suspend(std::coroutine_handle<Task::promise_type> h) const noexcept { h.promise().wait = Task::promise_type::WAIT_NONE; }
+        void await_resume() const noexcept { }
+
+        float microseconds;
+    };
+
 
     //////////////////////////////////////////////////////////////////////////
     // # draw functions
     //////////////////////////////////////////////////////////////////////////
     // all "draw" functions are only usable in callback function defined with "EnableEsp"
+    // or between BeginDrawList and PublishDrawList
+
+    // records the draw calls of the calling thread instead of drawing them. usable from any thread
+    void BeginDrawList();
+    // the list is drawn every frame after the esp callback until the thread publishes the next one.
+    // inside the esp callback, drawing goes back to the callback's own recording afterwards
+    void PublishDrawList();
+    // stops drawing the list of the calling thread
+    void ClearDrawList();
 
     void DrawLine(float x, float y, float x2, float y2, DWORD color);
     void DrawLineProjected(Vector3 pos1, Vector3 pos2, DWORD color);
@@ -186,9 +483,14 @@ namespace GW2LIB
     void DrawCircle(float mx, float my, float r, DWORD color);
     void DrawCircleFilled(float mx, float my, float r, DWORD color);
 
-    // circles are drawn parallel to xy-plane
+    // circles are drawn parallel to xy-plane, with more segments the larger they are on screen
     void DrawCircleProjected(Vector3 pos, float r, DWORD color);
     void DrawCircleFilledProjected(Vector3 pos, float r, DWORD color);
+    // filled band from r - width to r, e.g. for ranges
+    void DrawRingProjected(Vector3 pos, float r, float width, DWORD color);
+    // outline and filled sector angle radians wide, centered on the direction rot like Agent::GetRot
+    void DrawArcProjected(Vector3 pos, float r, float rot, float angle, DWORD color);
+    void DrawConeProjected(Vector3 pos, float r, float rot, float angle, DWORD color);
 
     // returns false when projected position is not on screen
     bool WorldToScreen(Vector3 in, float *outX, float *outY);
@@ -196,6 +498,38 @@ namespace GW2LIB
     float GetWindowWidth();
     float GetWindowHeight();
 
+    // collects projected circles and PrimitiveDiffuse draws of the frame and draws them farthest
+    // first after everything else, so translucent ones overlap correctly. off by default
+    void EnableDepthSorting(bool enable);
+
+    // projected lines, circles and PrimitiveDiffuse draws are checked against the view frustum
+    // before they are submitted. lines crossing the near plane are cut there
+    struct DrawStats {
+        // projected primitives of the last frame that were submitted and that were off screen
+        int primitivesDrawn;
+        int primitivesCulled;
+        // projected lines of the last frame that were cut at the near plane and that were off screen
+        int linesClipped;
+        int linesCulled;
+        // duration of the last esp callback and the draw call budget it currently gets
+        float espMicroseconds;
+        int espDrawCallBudget;
+        // labels from Font::QueueLabel of the last frame that were drawn, drawn away from their
+        // anchor and not drawn because there was no room
+        int labelsPlaced;
+        int labelsMoved;
+        int labelsDropped;
+    };
+    DrawStats GetDrawStats();
+
+    // limits what the esp draws per frame. every tick agents on screen are ranked by importance,
+    // selections and the own agent first, then by distance, threat and hostility, and get a
+    // level of detail so the total stays within maxDrawCalls, counting 4 for ESP_LOD_FULL, 2 for
+    // ESP_LOD_REDUCED and 1 for ESP_LOD_DOT. if maxMicroseconds is set the draw call budget
+    // shrinks while the esp callback takes longer than that and grows back when it is faster.
+    // 0 means no limit, which is the default
+    void SetEspBudget(int maxDrawCalls, float maxMicroseconds);
+
     //////////////////////////////////////////////////////////////////////////
     // # complex drawing classes
     //////////////////////////////////////////////////////////////////////////
@@ -217,14 +551,21 @@ namespace GW2LIB
         Font();
         bool Init(int size, std::string name);
         void Draw(float x, float y, DWORD color, std::string format, ...) const;
+        // text anchored to a world position, offset in pixels. not drawn if pos is behind the camera
+        void DrawProjected(Vector3 pos, float offX, float offY, DWORD color, std::string format, ...) const;
+        // like Draw, but drawn at the end of the frame where it does not overlap other labels.
+        // labels with higher priority are placed first, the others move up to two lines up or
+        // down or are dropped. the size of the text is estimated from the font size
+        void QueueLabel(float x, float y, float priority, DWORD color, std::string format, ...) const;
     private:
         Font(const Font &f) { }
         Font &operator= (const Font &f) { }
         const void *m_ptr;
+        int m_size;
     };
 
     // limitation of this: completly ignores depth checks
-    // what is drawn last, is on front
+    // what is drawn last, is on front, unless EnableDepthSorting is on
     class PrimitiveDiffuse {
     public:
         PrimitiveDiffuse();
@@ -245,7 +586,11 @@ namespace GW2LIB
     // # advanced
     //////////////////////////////////////////////////////////////////////////
 
+    // replaces the member offsets, e.g. to hot-patch after a game update. the defaults below are
+    // compiled into the refresh path as constants, offsets set here are read from memory instead.
+    // ResetMems goes back to the defaults
     void SetMems(const struct Mems& mems);
+    void ResetMems();
 
     struct Mems
     {
@@ -12,6 +12,8 @@
 #include <mutex>
 #include <thread>
 #include <chrono>
+#include <utility>
+#include <algorithm>
 
 
 void __fastcall hkGameThread(uintptr_t, int, int);
@@ -74,6 +76,8 @@ bool Gw2HackMain::init()
         m_con.printf(str.c_str());
     };
     hl::ConfigLog(logConfig);
+    // errors from the game, render and ingest threads go through the queue
+    AsyncLog::Start();
 
 #ifdef ARCH_64BIT
     uintptr_t MapIdSig = hl::FindPattern("\00\x00\x08\x00\x89\x0d\x00\x00\x00\x00\xc3", "xxxxxx????x");
@@ -147,6 +151,14 @@ bool Gw2HackMain::init()
     HL_LOG_DBG("ping:   %p\n", m_mems.pPing);
     HL_LOG_DBG("fps:    %p\n", m_mems.pFps);
 
+    m_staticLayout.charPlan = GameData::CompileCharacterReadPlan(m_staticLayout.mems);
+    m_staticLayout.agentPlan = GameData::CompileAgentReadPlan(m_staticLayout.mems);
+
+    m_derivedJobs.RegisterDefaults();
+
+    QueryPerformanceFrequency(&m_perfFreq);
+    StartIngest();
+
     // hook functions
 #ifdef NOD3DHOOK
     HL_LOG("Compiled to NOT hook D3D!\n");
@@ -185,10 +197,20 @@ bool Gw2HackMain::init()
 
     GW2LIB::gw2lib_main();
 
+    StopIngest();
+    AsyncLog::Stop();
+
     return false;
 }
 
 
+Gw2HackMain::~Gw2HackMain()
+{
+    StopIngest();
+    AsyncLog::Stop();
+}
+
+
 hl::Drawer *Gw2HackMain::GetDrawer(bool bUsedToRender)
 {
     if (m_drawer.GetDevice() && (!bUsedToRender || m_bPublicDrawer))
@@ -196,16 +218,118 @@ hl::Drawer *Gw2HackMain::GetDrawer(bool bUsedToRender)
     return nullptr;
 }
 
+// snapshot held by the current thread through GW2LIB::Snapshot
+static thread_local GameData::Snapshot *t_pSnapshot = nullptr;
+
 const GameData::GameData *Gw2HackMain::GetGameData() const
 {
+    if (t_pSnapshot)
+        return &t_pSnapshot->data;
     return &m_gameData;
 }
 
+GameData::Snapshot *Gw2HackMain::AcquireSnapshot()
+{
+    // snapshots are only made once someone asks for them, the first reader waits for one
+    if (!m_pSnapshot) {
+        m_bSnapshotsUsed = true;
+        std::unique_lock<std::mutex> lock(m_snapshotWaitMutex);
+        m_cvSnapshot.wait_for(lock, std::chrono::seconds(1), [this]{ return m_pSnapshot != nullptr; });
+    }
+
+    while (true)
+    {
+        GameData::Snapshot *pSnapshot = m_pSnapshot;
+        if (!pSnapshot)
+            return nullptr;
+
+        // the snapshot may have been replaced between the load and the increment. if it is still
+        // current afterwards, the ingest thread will not pick it for overwriting anymore
+        pSnapshot->readers++;
+        if (pSnapshot == m_pSnapshot) {
+            t_pSnapshot = pSnapshot;
+            return pSnapshot;
+        }
+        pSnapshot->readers--;
+    }
+}
+
+void Gw2HackMain::ReleaseSnapshot(GameData::Snapshot *pSnapshot, GameData::Snapshot *pPrevious)
+{
+    t_pSnapshot = pPrevious;
+    pSnapshot->readers--;
+}
+
+GameData::Snapshot *Gw2HackMain::GetThreadSnapshot() const
+{
+    return t_pSnapshot;
+}
+
 void Gw2HackMain::SetRenderCallback(void(*cbRender)())
 {
     m_cbRender = cbRender;
 }
 
+GW2LIB::DrawStats Gw2HackMain::GetDrawStats()
+{
+    std::lock_guard<std::mutex> lock(m_drawStatsMutex);
+    return m_drawStats;
+}
+
+void Gw2HackMain::SetEspRecordRate(float hz)
+{
+    m_espRecordInterval = hz > 0 ? static_cast<int64_t>(m_perfFreq.QuadPart / hz) : 0;
+}
+
+void Gw2HackMain::SetEspBudget(int maxDrawCalls, float maxMicroseconds)
+{
+    m_espMaxDrawCalls = maxDrawCalls;
+    m_espMaxMicroseconds = maxMicroseconds;
+    if (maxMicroseconds <= 0)
+        m_espDrawCallBudget = maxDrawCalls;
+}
+
+void Gw2HackMain::CallRenderCallback()
+{
+    LARGE_INTEGER start, end;
+    QueryPerformanceCounter(&start);
+
+    __try {
+        m_cbRender();
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        ASYNC_LOG_ERR("[ESP callback] Exception in ESP code\n");
+    }
+
+    QueryPerformanceCounter(&end);
+    UpdateEspBudget(static_cast<float>(end.QuadPart - start.QuadPart) * 1000000.0f / m_perfFreq.QuadPart);
+}
+
+void Gw2HackMain::UpdateEspBudget(float callbackMicroseconds)
+{
+    // the budget only has to move over a few frames, the lod job picks it up every tick
+    static const float BUDGET_LIMIT = 10000.0f;
+    static const float BUDGET_MIN = 64.0f;
+
+    m_espMicroseconds = callbackMicroseconds;
+
+    float maxMicroseconds = m_espMaxMicroseconds;
+    if (maxMicroseconds <= 0)
+        return;
+
+    int maxDrawCalls = m_espMaxDrawCalls;
+    float limit = maxDrawCalls ? static_cast<float>(maxDrawCalls) : BUDGET_LIMIT;
+    if (!m_espBudget)
+        m_espBudget = limit;
+
+    if (callbackMicroseconds > maxMicroseconds)
+        m_espBudget *= 0.9f;
+    else if (callbackMicroseconds < 0.75f*maxMicroseconds)
+        m_espBudget *= 1.05f;
+
+    m_espBudget = m_espBudget < BUDGET_MIN ? BUDGET_MIN : m_espBudget > limit ? limit : m_espBudget;
+    m_espDrawCallBudget = static_cast<int>(m_espBudget);
+}
+
 void Gw2HackMain::RenderHook(LPDIRECT3DDEVICE9 pDevice)
 {
     if (!m_drawer.GetDevice())
@@ -215,10 +339,17 @@ void Gw2HackMain::RenderHook(LPDIRECT3DDEVICE9 pDevice)
         D3DXMATRIX viewMat, projMat;
         D3DVIEWPORT9 viewport;
         pDevice->GetViewport(&viewport);
+        m_viewportWidth = viewport.Width;
+        m_viewportHeight = viewport.Height;
         D3DXMatrixLookAtLH(&viewMat, &m_gameData.camData.camPos, &(m_gameData.camData.camPos+m_gameData.camData.viewVec), &D3DXVECTOR3(0, 0, -1));
         D3DXMatrixPerspectiveFovLH(&projMat, m_gameData.camData.fovy, static_cast<float>(viewport.Width)/viewport.Height, 0.01f, 100000.0f);
         m_drawer.Update(viewMat, projMat);
 
+        Frustum frustum;
+        frustum.Build(viewMat * projMat);
+        float pixelScale = viewport.Height / (2*tan(m_gameData.camData.fovy/2));
+        m_primitiveBatch.Begin(&m_drawer, frustum, m_gameData.camData.camPos, pixelScale, m_bDepthSort);
+
         if (GetAsyncKeyState(VK_NUMPAD1) < 0) {
             pDevice->SetRenderState(D3DRS_CULLMODE, D3DCULL_CCW);
         }
@@ -230,106 +361,199 @@ void Gw2HackMain::RenderHook(LPDIRECT3DDEVICE9 pDevice)
         // draw rect to display active rendering
         m_drawer.DrawRectFilled(0, 0, 3, 3, 0x77ffff00);
 
-        if (m_cbRender) {
-            m_bPublicDrawer = true;
+        m_bPublicDrawer = true;
+
+        int64_t recordInterval = m_espRecordInterval;
+        if (m_cbRender && !recordInterval) {
+            CallRenderCallback();
+        } else if (m_cbRender) {
+            LARGE_INTEGER now;
+            QueryPerformanceCounter(&now);
+            if (now.QuadPart >= m_espNextRecord) {
+                m_espNextRecord = now.QuadPart + recordInterval;
+                m_espList.Clear();
+                DrawList::SetRecording(&m_espList);
+                CallRenderCallback();
+                DrawList::SetRecording(nullptr);
+            }
 
-            [&]()
-            {
-                __try {
-                    m_cbRender();
-                } __except (EXCEPTION_EXECUTE_HANDLER) {
-                    HL_LOG_ERR("[ESP callback] Exception in ESP code\n");
-                }
-            }();
+            // the drawer has the matrices of this frame, so projected commands are placed anew
+            m_espList.Submit(&m_drawer, &m_primitiveBatch, &m_labels);
+        }
+
+        // tasks get the rest of the frame, they may draw as well
+        m_tasks.RunFrame(m_tickSignal.Get());
+
+        m_drawQueues.Submit(&m_drawer, &m_primitiveBatch, &m_labels);
+
+        // sorted primitives of the whole frame go last, farthest first, and labels on top of them
+        m_primitiveBatch.Flush();
+        GW2LIB::DrawStats stats = m_primitiveBatch.GetStats();
+        m_labels.Flush(&m_drawer, stats);
 
-            m_bPublicDrawer = false;
+        {
+            std::lock_guard<std::mutex> lock(m_drawStatsMutex);
+            m_drawStats = stats;
+            m_drawStats.espMicroseconds = m_espMicroseconds;
+            m_drawStats.espDrawCallBudget = m_espDrawCallBudget;
         }
+
+        m_bPublicDrawer = false;
     }
 }
 
-void Gw2HackMain::RefreshDataAgent(GameData::AgentData *pAgentData, hl::ForeignClass agent)
+bool Gw2HackMain::IsQuarantined(void *p) const
+{
+    return !m_quarantine.empty() && m_quarantine.count(p);
+}
+
+void Gw2HackMain::Quarantine(void *p, const char *szWhere)
+{
+    m_quarantine[p] = m_tick + GameData::QUARANTINE_TICKS;
+    m_pCaptureWrite->objectFaults++;
+    ASYNC_LOG_ERR("[%s] access violation, skipping %p for %d ticks\n", szWhere, p, (int)GameData::QUARANTINE_TICKS);
+}
+
+bool Gw2HackMain::CaptureSpan(const GameData::ReadSpan &span, uint8_t *pRaw, const void *object, GW2LIB::CaptureField field)
 {
+    if (!m_pageCache.IsReadable(reinterpret_cast<const uint8_t*>(object) + span.begin, span.size)) {
+        m_pCaptureWrite->fieldFaults[field]++;
+        return false;
+    }
+
     __try {
-        pAgentData->pAgent = agent;
+        span.copy(pRaw, object);
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        m_pCaptureWrite->fieldFaults[field]++;
+        return false;
+    }
+    return true;
+}
+
+template <typename Layout>
+bool Gw2HackMain::CaptureAgent(const Layout &layout, GameData::AgentCapture *pCapture, uint8_t *pRaw, hl::ForeignClass agent)
+{
+    if (IsQuarantined(agent)) {
+        m_pCaptureWrite->quarantined++;
+        return false;
+    }
+    // vcalls read the vtable pointer first, a freed object is rejected here without an exception
+    if (!m_pageCache.IsReadable(agent, sizeof(void*))) {
+        Quarantine(agent, "CaptureAgent");
+        return false;
+    }
 
-        pAgentData->category = agent.call<GW2LIB::GW2::AgentCategory>(m_pubmems.agentVtGetCategory);
-        pAgentData->type = agent.call<GW2LIB::GW2::AgentType>(m_pubmems.agentVtGetType);
-        pAgentData->agentId = agent.call<int>(m_pubmems.agentVtGetId);
+    __try {
+        pCapture->category = agent.call<GW2LIB::GW2::AgentCategory>(layout.mems.agentVtGetCategory);
+        pCapture->type = agent.call<GW2LIB::GW2::AgentType>(layout.mems.agentVtGetType);
+        pCapture->agentId = agent.call<int>(layout.mems.agentVtGetId);
 
-        agent.call<void>(m_pubmems.agentVtGetPos, &pAgentData->pos);
-        hl::ForeignClass transform = agent.get<void*>(m_pubmems.agentTransform);
-        if (transform)
-        {
-            pAgentData->rot = atan2(transform.get<float>(m_pubmems.agtransRY), transform.get<float>(m_pubmems.agtransRX));
-        }
+        agent.call<void>(layout.mems.agentVtGetPos, &pCapture->pos);
+        void *transform = agent.get<void*>(layout.mems.agentTransform);
+        if (transform && CaptureSpan(layout.agentPlan.transform, pRaw, transform, GW2LIB::CAPTURE_FIELD_TRANSFORM))
+            pCapture->hasTransform = true;
 
     } __except (EXCEPTION_EXECUTE_HANDLER) {
-        HL_LOG_ERR("[RefreshDataAgent] access violation\n");
+        Quarantine(agent, "CaptureAgent");
+        return false;
     }
+    return true;
 }
-void Gw2HackMain::RefreshDataCharacter(GameData::CharacterData *pCharData, hl::ForeignClass character)
+
+template <typename Layout>
+bool Gw2HackMain::CaptureCharacter(const Layout &layout, GameData::CharacterCapture *pCapture, uint8_t *pRaw, hl::ForeignClass character, void *pNextCharacter)
 {
+    typedef GameData::CharacterCapture CC;
+
+    if (IsQuarantined(character)) {
+        m_pCaptureWrite->quarantined++;
+        return false;
+    }
+    if (!m_pageCache.IsReadable(character, sizeof(void*))) {
+        Quarantine(character, "CaptureCharacter");
+        return false;
+    }
+
     __try {
-        pCharData->pCharacter = character;
-
-        pCharData->isAlive = character.call<bool>(m_pubmems.charVtAlive);
-        pCharData->isDowned = character.call<bool>(m_pubmems.charVtDowned);
-        pCharData->isControlled = character.call<bool>(m_pubmems.charVtControlled);
-        pCharData->isPlayer = character.call<bool>(m_pubmems.charVtPlayer);
-        pCharData->isInWater = character.call<bool>(m_pubmems.charVtInWater);
-        pCharData->isMonster = character.call<bool>(m_pubmems.charVtMonster);
-        pCharData->isMonsterPlayerClone = character.call<bool>(m_pubmems.charVtClone);
-
-        pCharData->attitude = character.get<GW2LIB::GW2::Attitude>(m_pubmems.charAttitude);
-        pCharData->gliderPercent = character.get<float>(m_pubmems.charGliderPercent);
-
-        hl::ForeignClass health = character.get<void*>(m_pubmems.charHealth);
-        if (health) {
-            pCharData->currentHealth = health.get<float>(m_pubmems.healthCurrent);
-            pCharData->maxHealth = health.get<float>(m_pubmems.healthMax);
-        }
+        const auto& plan = layout.charPlan;
 
-        hl::ForeignClass endurance = character.get<void*>(m_pubmems.charEndurance);
-        if (endurance) {
-            pCharData->currentEndurance = static_cast<float>(endurance.get<int>(m_pubmems.endCurrent));
-            pCharData->maxEndurance = static_cast<float>(endurance.get<int>(m_pubmems.endMax));
-        }
+        // the next character is cold memory too, get it on the way while we do the vcalls
+        if (pNextCharacter)
+            plan.character.prefetch(pNextCharacter);
 
-        hl::ForeignClass corestats = character.get<void*>(m_pubmems.charCoreStats);
-        if (corestats) {
-            pCharData->profession = corestats.get<GW2LIB::GW2::Profession>(m_pubmems.statsProfession);
-            pCharData->level = corestats.get<int>(m_pubmems.statsLevel);
-            pCharData->scaledLevel = corestats.get<int>(m_pubmems.statsScaledLevel);
-        }
+        pCapture->agentId = character.call<int>(layout.mems.charVtGetAgentId);
 
-        hl::ForeignClass inventory = character.get<void*>(m_pubmems.charInventory);
-        if (inventory) {
-            pCharData->wvwsupply = inventory.get<int>(m_pubmems.invSupply);
+        pCapture->isAlive = character.call<bool>(layout.mems.charVtAlive);
+        pCapture->isDowned = character.call<bool>(layout.mems.charVtDowned);
+        pCapture->isControlled = character.call<bool>(layout.mems.charVtControlled);
+        pCapture->isPlayer = character.call<bool>(layout.mems.charVtPlayer);
+        pCapture->isInWater = character.call<bool>(layout.mems.charVtInWater);
+        pCapture->isMonster = character.call<bool>(layout.mems.charVtMonster);
+        pCapture->isMonsterPlayerClone = character.call<bool>(layout.mems.charVtClone);
+
+        // every sub-object is read on its own, one bad pointer only drops its span
+        if (CaptureSpan(plan.character, pRaw, character, GW2LIB::CAPTURE_FIELD_CHARACTER))
+        {
+            pCapture->spans |= CC::SPAN_CHARACTER;
+
+            void *health = plan.character.decode<void*>(pRaw, layout.mems.charHealth);
+            void *endurance = plan.character.decode<void*>(pRaw, layout.mems.charEndurance);
+            void *corestats = plan.character.decode<void*>(pRaw, layout.mems.charCoreStats);
+            void *inventory = plan.character.decode<void*>(pRaw, layout.mems.charInventory);
+            void *breakbar = plan.character.decode<void*>(pRaw, layout.mems.charBreakbar);
+
+            if (health && CaptureSpan(plan.health, pRaw, health, GW2LIB::CAPTURE_FIELD_HEALTH))
+                pCapture->spans |= CC::SPAN_HEALTH;
+            if (endurance && CaptureSpan(plan.endurance, pRaw, endurance, GW2LIB::CAPTURE_FIELD_ENDURANCE))
+                pCapture->spans |= CC::SPAN_ENDURANCE;
+            if (corestats && CaptureSpan(plan.coreStats, pRaw, corestats, GW2LIB::CAPTURE_FIELD_CORESTATS))
+                pCapture->spans |= CC::SPAN_CORESTATS;
+            if (inventory && CaptureSpan(plan.inventory, pRaw, inventory, GW2LIB::CAPTURE_FIELD_INVENTORY))
+                pCapture->spans |= CC::SPAN_INVENTORY;
+            if (breakbar && CaptureSpan(plan.breakbar, pRaw, breakbar, GW2LIB::CAPTURE_FIELD_BREAKBAR))
+                pCapture->spans |= CC::SPAN_BREAKBAR;
         }
 
-        hl::ForeignClass breakbar = character.get<void*>(m_pubmems.charBreakbar);
-        if (breakbar) {
-            pCharData->breakbarState = breakbar.get<GW2LIB::GW2::BreakbarState>(m_pubmems.breakbarState);
-            pCharData->breakbarPercent = breakbar.get<float>(m_pubmems.breakbarPercent);
+        if (pCapture->isPlayer)
+            pCapture->pPlayer = character.call<void*>(layout.mems.charVtGetPlayer);
+
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Quarantine(character, "CaptureCharacter");
+        return false;
+    }
+    return true;
+}
+
+template <typename Layout>
+void Gw2HackMain::CapturePlayer(const Layout &layout, GameData::PlayerCapture *pCapture, hl::ForeignClass player)
+{
+    if (IsQuarantined(player)) {
+        m_pCaptureWrite->quarantined++;
+        return;
+    }
+    if (!m_pageCache.IsReadable(reinterpret_cast<uint8_t*>(static_cast<void*>(player)) + layout.mems.playerName, sizeof(void*))) {
+        m_pCaptureWrite->fieldFaults[GW2LIB::CAPTURE_FIELD_PLAYERNAME]++;
+        return;
+    }
+
+    __try {
+        const wchar_t *name = player.get<wchar_t*>(layout.mems.playerName);
+        if (!m_pageCache.IsReadable(name, sizeof(wchar_t))) {
+            m_pCaptureWrite->fieldFaults[GW2LIB::CAPTURE_FIELD_PLAYERNAME]++;
+            return;
         }
 
-        if (pCharData->isPlayer)
-        {
-            hl::ForeignClass player = character.call<void*>(m_pubmems.charVtGetPlayer);
-            if (player)
-            {
-                char *name = player.get<char*>(m_pubmems.playerName);
-                int i = 0;
-                pCharData->name = "";
-                while (name[i]) {
-                    pCharData->name += name[i];
-                    i += 2;
-                }
-            }
+        size_t i = 0;
+        while (i < GameData::CAPTURE_NAME_MAX - 1 && name[i]) {
+            pCapture->name[i] = name[i];
+            i++;
         }
+        pCapture->name[i] = 0;
+        pCapture->hasName = true;
 
     } __except (EXCEPTION_EXECUTE_HANDLER) {
-        HL_LOG_ERR("[RefreshDataCharacter] access violation\n");
+        m_pCaptureWrite->fieldFaults[GW2LIB::CAPTURE_FIELD_PLAYERNAME]++;
+        Quarantine(player, "CapturePlayer");
     }
 }
 
@@ -346,157 +570,235 @@ void Gw2HackMain::GameHook()
 #endif
     m_mems.pCtx = pLocalStorage[0][1];
 
+    if (!m_pCaptureWrite)
+        return;
+
+    // offsets from SetMems take the generic path, the defaults are compiled in
+    if (m_pTickLayout)
+        CaptureTick(*m_pTickLayout);
+    else
+        CaptureTick(m_staticLayout);
+}
+
+template <typename Layout>
+void Gw2HackMain::CaptureTick(const Layout &layout)
+{
+    LARGE_INTEGER tStart;
+    QueryPerformanceCounter(&tStart);
+    auto elapsedMicroseconds = [&]() {
+        LARGE_INTEGER tNow;
+        QueryPerformanceCounter(&tNow);
+        return static_cast<float>(tNow.QuadPart - tStart.QuadPart) * 1000000.0f / m_perfFreq.QuadPart;
+    };
+
+    const auto& budget = m_tickBudget;
+    bool bBudget = budget.maxEntities > 0 || budget.maxMicroseconds > 0;
+
+    // release quarantined objects whose time is up
+    for (auto it = m_quarantine.begin(); it != m_quarantine.end(); ) {
+        if (it->second <= m_tick)
+            it = m_quarantine.erase(it);
+        else
+            ++it;
+    }
+    int pageCacheMisses = m_pageCache.GetMisses();
+
+    GameData::CaptureFrame &frame = *m_pCaptureWrite;
+    frame.tick = ++m_tick;
+    frame.pLayout = m_pTickLayout;
+    frame.budget = budget;
+    frame.entitiesRefreshed = 0;
+    frame.agentSlotsChanged = 0;
+    frame.vcallsSaved = 0;
+    frame.objectFaults = 0;
+    frame.quarantined = 0;
+    for (auto& faults : frame.fieldFaults)
+        faults = 0;
+    frame.objectsValid = false;
+    frame.agents.clear();
+    frame.chars.clear();
+    frame.players.clear();
+
     // get cam data
-    m_gameData.camData.valid = false;
+    frame.camValid = false;
     if (m_mems.ppWorldViewContext)
     {
         hl::ForeignClass wvctx = *m_mems.ppWorldViewContext;
-        if (wvctx && wvctx.get<int>(m_pubmems.wvctxStatus) == 1)
+        if (wvctx && wvctx.get<int>(layout.mems.wvctxStatus) == 1)
         {
-            D3DXVECTOR3 lookAt, upVec;
-            wvctx.call<void>(m_pubmems.wvctxVtGetMetrics, 1, &m_gameData.camData.camPos, &lookAt, &upVec, &m_gameData.camData.fovy);
-            D3DXVec3Normalize(&m_gameData.camData.viewVec, &(lookAt-m_gameData.camData.camPos));
-            m_gameData.camData.valid = true;
+            D3DXVECTOR3 upVec;
+            wvctx.call<void>(layout.mems.wvctxVtGetMetrics, 1, &frame.camPos, &frame.camLookAt, &upVec, &frame.fovy);
+            frame.camValid = true;
         }
     }
 
-    bool bOwnCharFound = false;
-    bool bOwnAgentFound = false;
-    bool bAutoSelectionFound = false;
-    bool bHoverSelectionFound = false;
-    bool bLockedSelectionFound = false;
-
     hl::ForeignClass avctx = m_mems.pAgentViewCtx;
     hl::ForeignClass asctx = m_mems.pAgentSelectionCtx;
 
-    if (m_gameData.camData.valid && m_mems.pCtx)
+    if (frame.camValid && m_mems.pCtx)
     {
         hl::ForeignClass ctx = m_mems.pCtx;
         if (ctx)
         {
-            hl::ForeignClass charctx = ctx.get<void*>(m_pubmems.contextChar);
+            hl::ForeignClass charctx = ctx.get<void*>(layout.mems.contextChar);
             if (charctx && avctx && asctx)
             {
-                auto charArray = charctx.get<GW2::ANet::Array<void*>>(m_pubmems.charctxCharArray);
-                auto agentArray = avctx.get<GW2::ANet::Array<void*>>(m_pubmems.avctxAgentArray);
+                auto charArray = charctx.get<GW2::ANet::Array<void*>>(layout.mems.charctxCharArray);
+                auto agentArray = avctx.get<GW2::ANet::Array<void*>>(layout.mems.avctxAgentArray);
 
                 if (charArray.IsValid() && agentArray.IsValid())
                 {
-                    // add agents from game array to own array and update data
+                    frame.objectsValid = true;
+                    frame.pControlledCharacter = charctx.get<void*>(layout.mems.charctxControlled);
+                    frame.pAutoSelection = asctx.get<void*>(layout.mems.asctxAuto);
+                    frame.pHoverSelection = asctx.get<void*>(layout.mems.asctxHover);
+                    frame.pLockedSelection = asctx.get<void*>(layout.mems.asctxLocked);
+
+                    // resolve every slot of the agent array into a flat array, empty slots stay empty.
+                    // this is the only vcall per slot, changed slots are found by comparing to the last tick
                     size_t sizeAgentArray = agentArray.Count();
-                    if (sizeAgentArray != m_gameData.objData.agentDataList.size()) {
-                        m_gameData.objData.agentDataList.resize(sizeAgentArray);
-                    }
+                    frame.agentStride = layout.agentPlan.stagingSize;
+                    frame.agents.resize(sizeAgentArray);
+                    if (frame.agentRaw.size() < sizeAgentArray * frame.agentStride)
+                        frame.agentRaw.resize(sizeAgentArray * frame.agentStride);
+                    m_agentSlots.resize(sizeAgentArray, nullptr);
+                    m_agentSlotsNext.resize(sizeAgentArray);
+                    m_agentSlotStates.resize(sizeAgentArray);
+
                     for (size_t i = 0; i < sizeAgentArray; i++)
                     {
+                        void *pAgent = nullptr;
                         hl::ForeignClass avAgent = agentArray[i];
 
                         if (avAgent) {
-                            hl::ForeignClass pAgent = avAgent.call<void*>(m_pubmems.avagVtGetAgent);
-
-                            if (pAgent) {
-                                // check if agent is already in our array
-                                GameData::AgentData *pAgentData = nullptr;
-
-                                if (m_gameData.objData.agentDataList[i] && m_gameData.objData.agentDataList[i]->pAgent == pAgent) {
-                                    // agent is already in our array. fix ptr
-                                    pAgentData = m_gameData.objData.agentDataList[i].get();
-                                }
-
-                                if (!pAgentData) {
-                                    // agent is not in our array. add and fix ptr
-                                    m_gameData.objData.agentDataList[i] = std::make_unique<GameData::AgentData>();
-                                    pAgentData = m_gameData.objData.agentDataList[i].get();
-                                }
-
-                                // update values
-                                RefreshDataAgent(pAgentData, pAgent);
+                            pAgent = avAgent.call<void*>(layout.mems.avagVtGetAgent);
+                            // the old validation pass did this vcall a second time
+                            frame.vcallsSaved++;
+                        }
 
-                                bool bCharDataFound = false;
+                        m_agentSlotsNext[i] = pAgent;
+                    }
 
-                                if (!bCharDataFound) {
-                                    pAgentData->pCharData = nullptr;
-                                }
+                    frame.agentSlotsChanged = GameData::DiffSlots(m_agentSlotsNext.data(), m_agentSlots.data(), sizeAgentArray, m_agentSlotsChanged);
+                    std::swap(m_agentSlots, m_agentSlotsNext);
 
-                                // set own agent
-                                if (m_gameData.objData.ownCharacter && m_gameData.objData.ownCharacter->pAgentData == pAgentData) {
-                                    m_gameData.objData.ownAgent = pAgentData;
-                                    bOwnAgentFound = true;
-                                }
+                    for (size_t i = 0; i < sizeAgentArray; i++)
+                    {
+                        void *pAgent = m_agentSlots[i];
+                        auto& capture = frame.agents[i];
+                        auto& slotState = m_agentSlotStates[i];
+                        capture.pAgent = pAgent;
+
+                        bool bNewAgent = GameData::IsSlotChanged(m_agentSlotsChanged, i);
+                        if (bNewAgent) {
+                            slotState = GameData::AgentSlotState();
+                        }
 
-                                // set selection agents
-                                if (pAgent == asctx.get<void*>(m_pubmems.asctxAuto)) {
-                                    m_gameData.objData.autoSelection = pAgentData;
-                                    bAutoSelectionFound = true;
-                                }
-                                if (pAgent == asctx.get<void*>(m_pubmems.asctxHover)) {
-                                    m_gameData.objData.hoverSelection = pAgentData;
-                                    bHoverSelectionFound = true;
-                                }
-                                if (pAgent == asctx.get<void*>(m_pubmems.asctxLocked)) {
-                                    m_gameData.objData.lockedSelection = pAgentData;
-                                    bLockedSelectionFound = true;
-                                }
-                            }
+                        // static agents stay in the slow lane until their recheck is due, unless the
+                        // ingest thread asks for them because they are selected or still have no data
+                        if (pAgent && ((slotState.IsDue(m_tick, m_refreshPriority.decodedTick) && (!bBudget || bNewAgent)) || m_refreshPriority.HasAgent(pAgent)) &&
+                            CaptureAgent(layout, &capture, frame.agentRaw.data() + i*frame.agentStride, pAgent)) {
+                            capture.refreshed = true;
+                            frame.entitiesRefreshed++;
+                            slotState.Update(capture, m_tick);
                         }
+                        capture.isStatic = slotState.isStatic;
                     }
 
-                    // remove non valid agents from list
-                    for (size_t i = 0; i < m_gameData.objData.agentDataList.size(); i++) {
-                        if (!m_gameData.objData.agentDataList[i]) {
-                            continue;
-                        }
+                    // same for characters
+                    int sizeCharArray = charArray.Count();
+                    frame.charStride = layout.charPlan.stagingSize;
+                    frame.chars.reserve(sizeCharArray);
+                    if (frame.charRaw.size() < sizeCharArray * frame.charStride)
+                        frame.charRaw.resize(sizeCharArray * frame.charStride);
+                    m_charSlots.resize(sizeCharArray, nullptr);
 
-                        // check if agent in our array is in game data
-                        bool bFound = false;
-                        hl::ForeignClass avAgent = agentArray[i];
+                    for (int i = 0; i < sizeCharArray; i++)
+                    {
+                        void *pCharacter = charArray[i];
 
-                        if (i < sizeAgentArray && avAgent) {
-                            if (avAgent.call<void*>(m_pubmems.avagVtGetAgent) == m_gameData.objData.agentDataList[i]->pAgent) {
-                                // agent was found in game. everything is fine
-                                bFound = true;
+                        if (pCharacter) {
+                            frame.chars.emplace_back();
+                            GameData::CharacterCapture *pCapture = &frame.chars.back();
+                            pCapture->pCharacter = pCharacter;
+
+                            if ((!bBudget || m_charSlots[i] != pCharacter || m_refreshPriority.HasChar(pCharacter)) &&
+                                CaptureCharacter(layout, pCapture, frame.charRaw.data() + (frame.chars.size()-1)*frame.charStride,
+                                    pCharacter, i+1 < sizeCharArray ? charArray[i+1] : nullptr)) {
+                                pCapture->refreshed = true;
+                                frame.entitiesRefreshed++;
                             }
                         }
 
-                        if (!bFound) {
-                            // agent was not found in game. remove from our array
-                            m_gameData.objData.agentDataList[i] = nullptr;
-                        }
+                        m_charSlots[i] = pCharacter;
                     }
 
-                    // add characters from game array to own array and update data
-                    m_gameData.objData.charDataList.clear();
-                    int sizeCharArray = charArray.Count();
-                    for (int i = 0; i < sizeCharArray; i++)
+                    // the player table. names only change with the player object, so they are
+                    // read once for every new player pointer
+                    auto playerArray = charctx.get<GW2::ANet::Array<void*>>(layout.mems.charctxPlayerArray);
+                    if (playerArray.IsValid())
                     {
-                        hl::ForeignClass pCharacter = charArray[i];
+                        int sizePlayerArray = playerArray.Count();
+                        frame.players.reserve(sizePlayerArray);
+                        m_knownPlayersNext.clear();
 
-                        if (pCharacter) {
-                            int agentId = pCharacter.call<int>(m_pubmems.charVtGetAgentId);
+                        for (int i = 0; i < sizePlayerArray; i++)
+                        {
+                            void *pPlayer = playerArray[i];
+                            if (!pPlayer)
+                                continue;
 
-                            m_gameData.objData.charDataList.push_back(std::make_unique<GameData::CharacterData>());
-                            GameData::CharacterData *pCharData = m_gameData.objData.charDataList.rbegin()->get();
+                            frame.players.emplace_back();
+                            GameData::PlayerCapture *pCapture = &frame.players.back();
+                            pCapture->pPlayer = pPlayer;
 
-                            // update values
-                            RefreshDataCharacter(pCharData, pCharacter);
+                            if (!std::binary_search(m_knownPlayers.begin(), m_knownPlayers.end(), pPlayer) || m_refreshPriority.HasPlayer(pPlayer))
+                                CapturePlayer(layout, pCapture, pPlayer);
 
-                            bool bAgentDataFound = false;
+                            m_knownPlayersNext.push_back(pPlayer);
+                        }
 
-                            // link agentdata of corresponding agent
-                            if (m_gameData.objData.agentDataList[agentId]) {
-                                pCharData->pAgentData = m_gameData.objData.agentDataList[agentId].get();
-                                pCharData->pAgentData->pCharData = pCharData;
-                                bAgentDataFound = true;
-                            }
+                        std::sort(m_knownPlayersNext.begin(), m_knownPlayersNext.end());
+                        std::swap(m_knownPlayers, m_knownPlayersNext);
+                    }
 
-                            if (!bAgentDataFound) {
-                                pCharData->pAgentData = nullptr;
+                    // spend what is left of the budget round-robin, alternating agents and characters
+                    if (bBudget)
+                    {
+                        size_t agentsLeft = sizeAgentArray;
+                        size_t charsLeft = frame.chars.size();
+
+                        while (agentsLeft || charsLeft)
+                        {
+                            if (budget.maxEntities && frame.entitiesRefreshed >= budget.maxEntities)
+                                break;
+                            if (budget.maxMicroseconds && elapsedMicroseconds() >= budget.maxMicroseconds)
+                                break;
+
+                            if (agentsLeft) {
+                                agentsLeft--;
+                                size_t i = m_agentCursor = (m_agentCursor + 1) % sizeAgentArray;
+                                auto& capture = frame.agents[i];
+                                auto& slotState = m_agentSlotStates[i];
+                                if (capture.pAgent && !capture.refreshed &&
+                                    (slotState.IsDue(m_tick, m_refreshPriority.decodedTick) || m_refreshPriority.HasAgent(capture.pAgent)) &&
+                                    CaptureAgent(layout, &capture, frame.agentRaw.data() + i*frame.agentStride, capture.pAgent)) {
+                                    capture.refreshed = true;
+                                    frame.entitiesRefreshed++;
+                                    slotState.Update(capture, m_tick);
+                                    capture.isStatic = slotState.isStatic;
+                                }
                             }
 
-                            // set own character
-                            if (pCharacter == charctx.get<void*>(m_pubmems.charctxControlled)) {
-                                m_gameData.objData.ownCharacter = pCharData;
-                                bOwnCharFound = true;
+                            if (charsLeft) {
+                                charsLeft--;
+                                size_t i = m_charCursor = (m_charCursor + 1) % frame.chars.size();
+                                auto& capture = frame.chars[i];
+                                if (!capture.refreshed &&
+                                    CaptureCharacter(layout, &capture, frame.charRaw.data() + i*frame.charStride, capture.pCharacter, nullptr)) {
+                                    capture.refreshed = true;
+                                    frame.entitiesRefreshed++;
+                                }
                             }
                         }
                     }
@@ -505,22 +807,60 @@ void Gw2HackMain::GameHook()
         }
     }
 
-    if (!bOwnCharFound)
-        m_gameData.objData.ownCharacter = nullptr;
-    if (!bOwnAgentFound)
-        m_gameData.objData.ownAgent = nullptr;
-    if (!bAutoSelectionFound)
-        m_gameData.objData.autoSelection = nullptr;
-    if (!bHoverSelectionFound)
-        m_gameData.objData.hoverSelection = nullptr;
-    if (!bLockedSelectionFound)
-        m_gameData.objData.lockedSelection = nullptr;
-
-    m_gameData.mouseInWorld = asctx.get<D3DXVECTOR3>(m_pubmems.asctxStoW);
-
-    m_gameData.mapId = *m_mems.pMapId;
-    m_gameData.ping = *m_mems.pPing;
-    m_gameData.fps = *m_mems.pFps;
+    frame.mouseInWorld = asctx.get<D3DXVECTOR3>(layout.mems.asctxStoW);
+
+    frame.mapId = *m_mems.pMapId;
+    frame.ping = *m_mems.pPing;
+    frame.fps = *m_mems.pFps;
+
+    frame.pageCacheMisses = m_pageCache.GetMisses() - pageCacheMisses;
+    frame.captureMicroseconds = elapsedMicroseconds();
+
+    PublishCapture();
+}
+
+void Gw2HackMain::PublishCapture()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_captureMutex);
+        std::swap(m_pCaptureWrite, m_pCapturePending);
+        m_bCapturePending = true;
+
+        // pick up settings and priorities for the next tick
+        m_tickBudget = m_refreshBudget;
+        m_pTickLayout = m_pRuntimeLayout;
+        if (m_bPageCacheNew) {
+            std::swap(m_pageCache, m_pageCacheNext);
+            m_bPageCacheNew = false;
+        }
+        if (m_bRefreshPriorityNew) {
+            std::swap(m_refreshPriority, m_refreshPriorityNext);
+            m_bRefreshPriorityNew = false;
+        }
+    }
+    m_cvCapture.notify_one();
+}
+
+void Gw2HackMain::SetRefreshBudget(const GameData::RefreshBudget &budget)
+{
+    std::lock_guard<std::mutex> lock(m_captureMutex);
+    m_refreshBudget = budget;
+}
+
+void Gw2HackMain::SetMems(const GW2LIB::Mems *pMems)
+{
+    std::unique_ptr<GameData::RuntimeLayout> pLayout;
+    if (pMems) {
+        pLayout = std::make_unique<GameData::RuntimeLayout>();
+        pLayout->mems = *pMems;
+        pLayout->charPlan = GameData::CompileCharacterReadPlan(pLayout->mems);
+        pLayout->agentPlan = GameData::CompileAgentReadPlan(pLayout->mems);
+    }
+
+    std::lock_guard<std::mutex> lock(m_captureMutex);
+    m_pRuntimeLayout = pLayout.get();
+    if (pLayout)
+        m_runtimeLayouts.push_back(std::move(pLayout));
 }
 
 
@@ -532,13 +872,12 @@ void __fastcall hkGameThread(uintptr_t pInst, int, int arg)
 
     if (pCore)
     {
-        std::lock_guard<std::mutex> lock(pCore->m_gameDataMutex);
-
+        // only raw data is captured here, m_gameData is written by the ingest thread
         [&]{
             __try {
                 pCore->GameHook();
             } __except (EXCEPTION_EXECUTE_HANDLER) {
-                HL_LOG_ERR("[hkGameThread] Exception in game thread\n");
+                ASYNC_LOG_ERR("[hkGameThread] Exception in game thread\n");
             }
         }();
     }
@@ -553,15 +892,19 @@ HRESULT __stdcall hkPresent(LPDIRECT3DDEVICE9 pDevice, RECT* pSourceRect, RECT*
 
     if (pCore)
     {
-        std::lock_guard<std::mutex> lock(pCore->m_gameDataMutex);
+        {
+            std::lock_guard<std::mutex> lock(pCore->m_gameDataMutex);
 
-        [&]{
-            __try {
-                pCore->RenderHook(pDevice);
-            } __except (EXCEPTION_EXECUTE_HANDLER) {
-                HL_LOG_ERR("[hkPresent] Exception in render thread\n");
-            }
-        }();
+            [&]{
+                __try {
+                    pCore->RenderHook(pDevice);
+                } __except (EXCEPTION_EXECUTE_HANDLER) {
+                    ASYNC_LOG_ERR("[hkPresent] Exception in render thread\n");
+                }
+            }();
+        }
+
+        pCore->m_frameSignal.Signal();
     }
 
     return orgFunc(pDevice, pDevice, pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion);
@@ -578,7 +921,7 @@ HRESULT __stdcall hkReset(LPDIRECT3DDEVICE9 pDevice, D3DPRESENT_PARAMETERS *pPre
             __try {
                 pCore->GetDrawer(false)->OnLostDevice();
             } __except (EXCEPTION_EXECUTE_HANDLER) {
-                HL_LOG_ERR("[hkReset] Exeption in pre device reset hook\n");
+                ASYNC_LOG_ERR("[hkReset] Exeption in pre device reset hook\n");
             }
         }();
     }
@@ -591,7 +934,7 @@ HRESULT __stdcall hkReset(LPDIRECT3DDEVICE9 pDevice, D3DPRESENT_PARAMETERS *pPre
             __try {
                 pCore->GetDrawer(false)->OnResetDevice();
             } __except (EXCEPTION_EXECUTE_HANDLER) {
-                HL_LOG_ERR("[hkReset] Exception in post device reset hook\n");
+                ASYNC_LOG_ERR("[hkReset] Exception in post device reset hook\n");
             }
         }();
     }
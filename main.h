@@ -3,6 +3,18 @@
 
 #include "gw2lib.h"
 #include "GameData.h"
+#include "ReadPlan.h"
+#include "Layout.h"
+#include "PageCache.h"
+#include "SnapshotExport.h"
+#include "Capture.h"
+#include "JobPool.h"
+#include "DerivedData.h"
+#include "AsyncLog.h"
+#include "SequenceSignal.h"
+#include "TaskScheduler.h"
+#include "DrawList.h"
+#include "PrimitiveBatch.h"
 
 #include "hacklib/Main.h"
 #include "hacklib/ConsoleEx.h"
@@ -10,6 +22,11 @@
 #include "hacklib/Drawer.h"
 
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
 
 
 class Gw2HackMain *GetMain();
@@ -30,27 +47,91 @@ struct GamePointers
 class Gw2HackMain : public hl::Main
 {
 public:
+    ~Gw2HackMain();
+
     bool init() override;
 
     const GamePointers *GetGamePointers() const { return &m_mems; }
 
     hl::Drawer *GetDrawer(bool bUsedToRender);
+    // the snapshot the calling thread holds, the live data otherwise
     const GameData::GameData *GetGameData() const;
+    const GameData::NameTable *GetNameTable() const { return &m_names; }
+
+    // pins the newest snapshot to the calling thread until it is released. returns nullptr if
+    // nothing was published within a second
+    GameData::Snapshot *AcquireSnapshot();
+    void ReleaseSnapshot(GameData::Snapshot *pSnapshot, GameData::Snapshot *pPrevious);
+    GameData::Snapshot *GetThreadSnapshot() const;
 
     void SetRenderCallback(void (*cbRender)());
+    // 0 calls the callback every frame
+    void SetEspRecordRate(float hz);
+    void SetEspBudget(int maxDrawCalls, float maxMicroseconds);
+    TaskScheduler *GetTaskScheduler() { return &m_tasks; }
+    GameData::DerivedJobs *GetDerivedJobs() { return &m_derivedJobs; }
+    DrawQueues *GetDrawQueues() { return &m_drawQueues; }
+    // culls projected lines and primitives and sorts them if depth sorting is on. render thread
+    PrimitiveBatch *GetPrimitiveBatch() { return &m_primitiveBatch; }
+    // labels queued this frame, placed and drawn last. render thread
+    LabelPlacer *GetLabelPlacer() { return &m_labels; }
+    void SetDepthSort(bool bEnable) { m_bDepthSort = bEnable; }
+    GW2LIB::DrawStats GetDrawStats();
 
     void RenderHook(LPDIRECT3DDEVICE9 pDevice);
     void GameHook();
 
+    void StartIngest();
+    void StopIngest();
+
+    void SetRefreshBudget(const GameData::RefreshBudget &budget);
+    // nullptr switches back to the compiled in default offsets
+    void SetMems(const GW2LIB::Mems *pMems);
+    // nullptr stops the export
+    bool SetSnapshotExport(const char *name);
+
     const hl::IHook *m_hkPresent = nullptr;
     const hl::IHook *m_hkReset = nullptr;
     const hl::IHook *m_hkAlertCtx = nullptr;
 
     std::mutex m_gameDataMutex;
+    // counts decoded ticks and presented frames
+    SequenceSignal m_tickSignal;
+    SequenceSignal m_frameSignal;
 
 private:
-    void RefreshDataAgent(GameData::AgentData *pAgentData, hl::ForeignClass agent);
-    void RefreshDataCharacter(GameData::CharacterData *pCharData, hl::ForeignClass character);
+    // game thread: copy raw data. instantiated for GameData::StaticLayout and GameData::RuntimeLayout
+    template <typename Layout>
+    void CaptureTick(const Layout &layout);
+    // return false if the object was skipped or faulted, it is quarantined then
+    template <typename Layout>
+    bool CaptureAgent(const Layout &layout, GameData::AgentCapture *pCapture, uint8_t *pRaw, hl::ForeignClass agent);
+    template <typename Layout>
+    bool CaptureCharacter(const Layout &layout, GameData::CharacterCapture *pCapture, uint8_t *pRaw, hl::ForeignClass character, void *pNextCharacter);
+    template <typename Layout>
+    void CapturePlayer(const Layout &layout, GameData::PlayerCapture *pCapture, hl::ForeignClass player);
+    bool CaptureSpan(const GameData::ReadSpan &span, uint8_t *pRaw, const void *object, GW2LIB::CaptureField field);
+    bool IsQuarantined(void *p) const;
+    void Quarantine(void *p, const char *szWhere);
+    void PublishCapture();
+
+    // ingest thread: decode raw data into m_gameData
+    void IngestLoop();
+    void DecodeCapture(const GameData::CaptureFrame &frame);
+    template <typename Layout>
+    void DecodeAgent(const Layout &layout, GameData::AgentData *pAgentData, const GameData::AgentCapture &capture, const uint8_t *pRaw);
+    template <typename Layout>
+    void DecodeCharacter(const Layout &layout, GameData::CharacterData *pCharData, const GameData::CharacterCapture &capture, const uint8_t *pRaw);
+    void DecodePlayers(const GameData::CaptureFrame &frame);
+    void UpdateStaticAgents(int mapId);
+    void UpdateRefreshPriority(const GameData::CaptureFrame &frame);
+    void UpdateRefreshStats(const GameData::CaptureFrame &frame);
+    void RunDerivedJobs();
+    void PublishSnapshot(uint64_t tick);
+
+    // render thread
+    void CallRenderCallback();
+    void UpdateEspBudget(float callbackMicroseconds);
 
 private:
     hl::ConsoleEx m_con;
@@ -58,12 +139,95 @@ private:
     hl::Drawer m_drawer;
 
     GameData::GameData m_gameData;
+    // player names, interned once per distinct name and never released
+    GameData::NameTable m_names;
+
+    // reader snapshots, filled by the ingest thread after every decode once a reader asked for one
+    static const int SNAPSHOT_COUNT = 4;
+    std::unique_ptr<GameData::Snapshot> m_snapshots[SNAPSHOT_COUNT];
+    std::atomic<GameData::Snapshot*> m_pSnapshot{nullptr};
+    std::atomic<bool> m_bSnapshotsUsed{false};
+    std::mutex m_snapshotWaitMutex;
+    std::condition_variable m_cvSnapshot;
 
     bool m_bPublicDrawer = false;
     void(*m_cbRender)() = nullptr;
+    // performance counter ticks between recordings of the esp callback, 0 when not recording
+    std::atomic<int64_t> m_espRecordInterval{0};
+    int64_t m_espNextRecord = 0;
+    DrawList m_espList;
+    std::atomic<bool> m_bDepthSort{false};
+    PrimitiveBatch m_primitiveBatch;
+    LabelPlacer m_labels;
+    // limits from SetEspBudget and the draw call budget the lod job gets, adapted by the render thread
+    std::atomic<int> m_espMaxDrawCalls{0};
+    std::atomic<float> m_espMaxMicroseconds{0};
+    std::atomic<int> m_espDrawCallBudget{0};
+    float m_espBudget = 0;
+    float m_espMicroseconds = 0;
+    std::mutex m_drawStatsMutex;
+    GW2LIB::DrawStats m_drawStats = {};
+    TaskScheduler m_tasks;
+    // lists published by other threads through GW2LIB::PublishDrawList
+    DrawQueues m_drawQueues;
 
     GamePointers m_mems;
-    GW2LIB::Mems m_pubmems;
+
+    GameData::StaticLayout m_staticLayout;
+    std::vector<std::unique_ptr<GameData::RuntimeLayout>> m_runtimeLayouts;
+    const GameData::RuntimeLayout *m_pRuntimeLayout = nullptr;
+
+    // triple buffered capture frames. the game thread only holds m_captureMutex to swap pointers
+    std::unique_ptr<GameData::CaptureFrame> m_captureFrames[3];
+    GameData::CaptureFrame *m_pCaptureWrite = nullptr;
+    GameData::CaptureFrame *m_pCapturePending = nullptr;
+    GameData::CaptureFrame *m_pCaptureDecode = nullptr;
+    bool m_bCapturePending = false;
+    bool m_bIngestStop = false;
+    std::mutex m_captureMutex;
+    std::condition_variable m_cvCapture;
+    std::thread m_ingestThread;
+    JobPool m_jobPool;
+    GameData::DerivedJobs m_derivedJobs;
+    // viewport of the last frame for the screen positions of the derived jobs
+    std::atomic<uint32_t> m_viewportWidth{0};
+    std::atomic<uint32_t> m_viewportHeight{0};
+
+    // refresh budget. the game thread works on copies that are exchanged in PublishCapture
+    GameData::RefreshBudget m_refreshBudget;
+    GameData::RefreshPriority m_refreshPriorityNext;
+    bool m_bRefreshPriorityNew = false;
+    GameData::PageCache m_pageCacheNext;
+    bool m_bPageCacheNew = false;
+
+    // game thread state
+    GameData::RefreshBudget m_tickBudget;
+    const GameData::RuntimeLayout *m_pTickLayout = nullptr;
+    GameData::PageCache m_pageCache;
+    // faulting game objects and the tick they are released
+    std::unordered_map<void*, uint64_t> m_quarantine;
+    GameData::RefreshPriority m_refreshPriority;
+    // resolved Agent::CAgentBase* per agent array slot of the last and the current tick
+    std::vector<void*> m_agentSlots;
+    std::vector<void*> m_agentSlotsNext;
+    std::vector<uint32_t> m_agentSlotsChanged;
+    std::vector<GameData::AgentSlotState> m_agentSlotStates;
+    // sorted player pointers of the last tick
+    std::vector<void*> m_knownPlayers;
+    std::vector<void*> m_knownPlayersNext;
+    std::vector<void*> m_charSlots;
+    size_t m_agentCursor = 0;
+    size_t m_charCursor = 0;
+    uint64_t m_tick = 0;
+    LARGE_INTEGER m_perfFreq;
+
+    // ingest thread state
+    std::vector<std::unique_ptr<GameData::CharacterData>> m_charDataScratch;
+    std::vector<std::unique_ptr<GameData::PlayerData>> m_playerDataScratch;
+    size_t m_staticAgentCount = 0;
+    uint64_t m_pageCacheRebuildTick = 0;
+    std::mutex m_snapshotMutex;
+    GameData::SnapshotExport m_snapshotExport;
 
 };
 